@@ -0,0 +1,41 @@
+#!/bin/bash
+# DXT encoder quality levels
+#
+# Usage: ./bench/dxt.sh [<image>...]
+# Converts each image (defaults to the PAA test textures) with the high and
+# fast DXT encoders and prints the time taken and, if ImageMagick's compare
+# is available, the RMSE of the decoded result against the source.
+
+images=("$@")
+if [ ${#images[@]} -eq 0 ]; then
+    images=(test/paa/test.png test/paa/test_alpha.png)
+fi
+
+tmp=$(mktemp -d) || exit 1
+
+now() {
+    date +%s.%N
+}
+
+for image in "${images[@]}"; do
+    echo "$image:"
+    for quality in high fast; do
+        start=$(now)
+        ./bin/armake img2paa -f -q $quality "$image" $tmp/$quality.paa || {
+            rm -rf $tmp
+            exit 1
+        }
+        end=$(now)
+
+        error=""
+        if command -v compare > /dev/null; then
+            ./bin/armake paa2img -f $tmp/$quality.paa $tmp/$quality.png
+            error=$(compare -metric RMSE "$image" $tmp/$quality.png /dev/null 2>&1)
+            error=" rmse $error"
+        fi
+
+        awk "BEGIN { printf \"    %-5s %8.3fs%s\\n\", \"$quality\", $end - $start, \"$error\" }"
+    done
+done
+
+rm -rf $tmp
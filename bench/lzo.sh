@@ -0,0 +1,50 @@
+#!/bin/bash
+# LZO compression levels
+#
+# Usage: ./bench/lzo.sh [<image>...]
+# Converts each image (defaults to the PAA test textures) without compression
+# and with both LZO levels, then prints the time spent compressing, the
+# resulting throughput and the compressed size relative to the uncompressed
+# PAA.
+
+images=("$@")
+if [ ${#images[@]} -eq 0 ]; then
+    images=(test/paa/test.png test/paa/test_alpha.png)
+fi
+
+tmp=$(mktemp -d) || exit 1
+
+now() {
+    date +%s.%N
+}
+
+for image in "${images[@]}"; do
+    echo "$image:"
+
+    start=$(now)
+    ./bin/armake img2paa -f "$image" $tmp/none.paa || {
+        rm -rf $tmp
+        exit 1
+    }
+    end=$(now)
+    base=$(awk "BEGIN { print $end - $start }")
+    size=$(wc -c < $tmp/none.paa)
+
+    for level in fast best; do
+        start=$(now)
+        ./bin/armake img2paa -f -z -l $level "$image" $tmp/$level.paa || {
+            rm -rf $tmp
+            exit 1
+        }
+        end=$(now)
+        compressed=$(wc -c < $tmp/$level.paa)
+
+        awk "BEGIN {
+            t = $end - $start - $base;
+            if (t < 0.001) t = 0.001;
+            printf \"    %-4s %8.3fs %8.1f MB/s  ratio %.3f\\n\", \"$level\", t, $size / t / 1000000, $compressed / $size
+        }"
+    done
+done
+
+rm -rf $tmp
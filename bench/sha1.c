@@ -0,0 +1,78 @@
+/*
+ * SHA1 backend throughput
+ *
+ * Hashes the same buffer with every backend of src/hash.c in chunks of
+ * several sizes, prints the throughput and checks that the digests agree.
+ * Built and run by bench/sha1.sh.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+
+#define BUFFER_SIZE (64 * 1024 * 1024)
+
+
+double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+    char *names[] = { "openssl", "portable" };
+    size_t chunks[] = { 64, 4096, 65536 };
+    unsigned char reference[20];
+    unsigned char hash[20];
+    unsigned char *buffer;
+    struct sha1 sha;
+    double start;
+    double t;
+    size_t i;
+    int backend;
+    int c;
+
+    buffer = (unsigned char *)malloc(BUFFER_SIZE);
+    if (buffer == NULL)
+        return 1;
+
+    srand(1);
+    for (i = 0; i < BUFFER_SIZE; i++)
+        buffer[i] = rand() & 0xff;
+
+    for (backend = SHA1_BACKEND_OPENSSL; backend <= SHA1_BACKEND_PORTABLE; backend++) {
+        sha1_backend = backend;
+
+        for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            start = now();
+
+            sha1_init(&sha);
+            if (backend == SHA1_BACKEND_OPENSSL && sha.backend != SHA1_BACKEND_OPENSSL)
+                printf("    %-8s not available\n", names[backend]);
+            for (i = 0; i < BUFFER_SIZE; i += chunks[c])
+                sha1_update(&sha, buffer + i, chunks[c]);
+            if (sha1_final(&sha, hash))
+                return 1;
+
+            t = now() - start;
+
+            if (backend == SHA1_BACKEND_OPENSSL && c == 0)
+                memcpy(reference, hash, 20);
+
+            printf("    %-8s %6lu B chunks %8.3fs %8.1f MB/s%s\n", names[backend],
+                (unsigned long)chunks[c], t, BUFFER_SIZE / t / 1000000,
+                memcmp(hash, reference, 20) ? "  MISMATCH" : "");
+        }
+    }
+
+    free(buffer);
+
+    return 0;
+}
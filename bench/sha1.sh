@@ -0,0 +1,20 @@
+#!/bin/bash
+# SHA1 backends
+#
+# Usage: ./bench/sha1.sh
+# Builds bench/sha1.c against the hashing layer and prints the throughput of
+# the OpenSSL and the portable SHA1 implementation for a 64 MB buffer.
+
+tmp=$(mktemp -d) || exit 1
+
+${CC:-gcc} -O2 -std=gnu89 -Isrc -Ilib bench/sha1.c src/hash.c lib/sha1.c -lcrypto -o $tmp/sha1 || {
+    rm -rf $tmp
+    exit 1
+}
+
+echo "sha1:"
+$tmp/sha1
+status=$?
+
+rm -rf $tmp
+exit $status
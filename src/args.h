@@ -30,10 +30,16 @@ struct arguments {
     bool force;
     bool packonly;
     bool compress;
+    bool batch;
     char *privatekey;
     char *signature;
     char *indent;
     char *paatype;
+    char *quality;
+    char *level;
+    char *resize;
+    char *mip;
+    char *maxsize;
     int num_mutedwarnings;
     char **mutedwarnings;
     int num_includefolders;
@@ -27,7 +27,7 @@
 #include <windows.h>
 #endif
 
-#include "sha1.h"
+#include "hash.h"
 #include "args.h"
 #include "binarize.h"
 #include "filesystem.h"
@@ -79,9 +79,114 @@ int binarize_callback(char *root, char *source, char *junk) {
 }
 
 
-int write_header_to_pbo(char *root, char *source, char *target) {
+int open_pbo_writer(struct pbo_writer *writer, char *path) {
+    /*
+     * Opens a PBO for writing. Everything written through the writer is
+     * hashed on the way, so the checksum and signature don't require
+     * reading the PBO again.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    memset(writer, 0, sizeof(struct pbo_writer));
+
+    writer->f = fopen(path, "wb");
+    if (!writer->f)
+        return 1;
+
+    sha1_init(&writer->checksum);
+    sha1_init(&writer->filehash);
+    writer->nothing = true;
+
+    return 0;
+}
+
+
+void free_pbo_writer(struct pbo_writer *writer) {
+    int i;
+
+    if (writer->f)
+        fclose(writer->f);
+
+    for (i = 0; i < writer->num_names; i++)
+        free(writer->names[i]);
+    free(writer->names);
+
+    sha1_free(&writer->checksum);
+    sha1_free(&writer->filehash);
+
+    memset(writer, 0, sizeof(struct pbo_writer));
+}
+
+
+int pbo_write(struct pbo_writer *writer, const void *data, size_t size) {
+    /*
+     * Writes data to the PBO and adds it to the checksum.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    if (size == 0)
+        return 0;
+
+    if (fwrite(data, size, 1, writer->f) != 1)
+        return 1;
+
+    sha1_update(&writer->checksum, (const unsigned char *)data, size);
+
+    return 0;
+}
+
+
+int pbo_write_extension(struct pbo_writer *writer, char *string) {
+    /*
+     * Writes a header extension string (key or value, an empty string
+     * ends the list). Keeps track of the prefix the same way hash_pbo
+     * finds it when reading the PBO.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    if (!writer->extensions_done) {
+        if (strcmp(writer->last_extension, "prefix") == 0)
+            strncpy(writer->prefix, string, sizeof(writer->prefix) - 1);
+        if (strlen(string) == 0)
+            writer->extensions_done = true;
+        strncpy(writer->last_extension, string, sizeof(writer->last_extension) - 1);
+    }
+
+    return pbo_write(writer, string, strlen(string) + 1);
+}
+
+
+void get_pbo_name(char *root, char *source, char *filename) {
+    /*
+     * Gets the name a file is stored under in the PBO: relative to the
+     * root, with backslashes and .p3do files renamed to .p3d.
+     */
+
+    int i;
+
+    filename[0] = 0;
+    strcat(filename, source + strlen(root) + 1);
+
+    // replace pathseps on linux
+#ifndef _WIN32
+    for (i = 0; i < strlen(filename); i++) {
+        if (filename[i] == '/')
+            filename[i] = '\\';
+    }
+#endif
+
+    // replace .p3do ending
+    if (strlen(filename) > 5 && !strcmp(filename + strlen(filename) - 5, ".p3do"))
+        filename[strlen(filename) - 1] = 0;
+}
+
+
+int write_header_to_pbo(char *root, char *source, char *data) {
+    struct pbo_writer *writer = (struct pbo_writer *)data;
     FILE *f_source;
-    FILE *f_target;
     char filename[1024];
 
     filename[0] = 0;
@@ -90,10 +195,6 @@ int write_header_to_pbo(char *root, char *source, char *target) {
     if (!file_allowed(filename))
         return 0;
 
-    f_target = fopen(target, "ab");
-    if (!f_target)
-        return -1;
-
     struct {
         uint32_t method;
         uint32_t originalsize;
@@ -106,44 +207,39 @@ int write_header_to_pbo(char *root, char *source, char *target) {
     header.timestamp = 0;
 
     f_source = fopen(source, "rb");
-    if (!f_source) {
-        fclose(f_target);
+    if (!f_source)
         return -2;
-    }
 
     fseek(f_source, 0, SEEK_END);
     header.datasize = ftell(f_source);
     header.originalsize = header.datasize;
     fclose(f_source);
 
-    // replace pathseps on linux
-#ifndef _WIN32
-    int i;
-    for (i = 0; i < strlen(filename); i++) {
-        if (filename[i] == '/')
-            filename[i] = '\\';
-    }
-#endif
+    get_pbo_name(root, source, filename);
 
-    // replace .p3do ending
-    if (strlen(filename) > 5 && !strcmp(filename + strlen(filename) - 5, ".p3do"))
-        filename[strlen(filename) - 1] = 0;
-
-    fwrite(filename, strlen(filename), 1, f_target);
-    fputc(0, f_target);
+    if (pbo_write(writer, filename, strlen(filename) + 1) ||
+            pbo_write(writer, &header, sizeof(header)))
+        return -1;
 
-    fwrite(&header, sizeof(header), 1, f_target);
-    fclose(f_target);
+    // remember the names of non-empty files for the name hash
+    if (header.datasize > 0) {
+        if (writer->num_names % 32 == 0)
+            writer->names = (char **)safe_realloc(writer->names, sizeof(char *) * (writer->num_names + 32));
+        writer->names[writer->num_names] = safe_strdup(filename);
+        lower_case(writer->names[writer->num_names]);
+        writer->num_names++;
+    }
 
     return 0;
 }
 
 
-int write_data_to_pbo(char *root, char *source, char *target) {
+int write_data_to_pbo(char *root, char *source, char *data) {
+    struct pbo_writer *writer = (struct pbo_writer *)data;
     FILE *f_source;
-    FILE *f_target;
     char buffer[4096];
     char filename[1024];
+    bool hashed;
     int datasize;
     int i;
 
@@ -159,63 +255,26 @@ int write_data_to_pbo(char *root, char *source, char *target) {
     fseek(f_source, 0, SEEK_END);
     datasize = ftell(f_source);
 
-    f_target = fopen(target, "ab");
-    if (!f_target) {
-        fclose(f_source);
-        return -2;
-    }
+    // feed the file hash for signing with the same files hash_pbo would use
+    get_pbo_name(root, source, filename);
+    lower_case(filename);
+    hashed = datasize > 0 && is_hashed_file(filename);
+    if (hashed)
+        writer->nothing = false;
 
     fseek(f_source, 0, SEEK_SET);
-    for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-        fread(buffer, sizeof(buffer), 1, f_source);
-        fwrite(buffer, sizeof(buffer), 1, f_target);
-    }
-    fread(buffer, datasize - i, 1, f_source);
-    fwrite(buffer, datasize - i, 1, f_target);
-
-    fclose(f_source);
-    fclose(f_target);
-
-    return 0;
-}
-
-
-int hash_file(char *path, unsigned char *hash) {
-    SHA1Context sha;
-    FILE *file;
-    int filesize, i;
-    unsigned temp;
-    char buffer[4096];
-
-    SHA1Reset(&sha);
-
-    file = fopen(path, "rb");
-    if (!file)
-        return -1;
-
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    for (i = 0; filesize - i >= sizeof(buffer); i += sizeof(buffer)) {
-        fread(buffer, sizeof(buffer), 1, file);
-        SHA1Input(&sha, (const unsigned char *)buffer, sizeof(buffer));
-    }
-    fread(buffer, filesize - i, 1, file);
-    SHA1Input(&sha, (const unsigned char *)buffer, filesize - i);
-
-    fclose(file);
-
-    if (!SHA1Result(&sha))
-        return -2;
+    for (i = 0; i < datasize; i += sizeof(buffer)) {
+        if (fread(buffer, MIN(datasize - i, sizeof(buffer)), 1, f_source) != 1 ||
+                pbo_write(writer, buffer, MIN(datasize - i, sizeof(buffer)))) {
+            fclose(f_source);
+            return -2;
+        }
 
-    for (i = 0; i < 5; i++) {
-        temp = sha.Message_Digest[i];
-        sha.Message_Digest[i] = ((temp>>24)&0xff) |
-            ((temp<<8)&0xff0000) | ((temp>>8)&0xff00) | ((temp<<24)&0xff000000);
+        if (hashed)
+            sha1_update(&writer->filehash, (const unsigned char *)buffer, MIN(datasize - i, sizeof(buffer)));
     }
 
-    memcpy(hash, sha.Message_Digest, 20);
+    fclose(f_source);
 
     return 0;
 }
@@ -228,6 +287,8 @@ int cmd_build() {
     int k;
     char buffer[512];
     bool valid = false;
+    char windows_prefix[512];
+    struct pbo_writer writer;
 
     if (args.num_positionals != 3)
         return 128;
@@ -259,6 +320,7 @@ int cmd_build() {
     char addonprefix[512];
     FILE *f_prefix;
     prefixpath[0] = 0;
+    addonprefix[0] = 0;
     strcat(prefixpath, args.positionals[1]);
     strcat(prefixpath, PATHSEP_STR);
     strcat(prefixpath, "$PBOPREFIX$");
@@ -369,15 +431,21 @@ int cmd_build() {
     current_target = args.positionals[1];
 
     // write header extensions
-    f_target = fopen(args.positionals[2], "wb");
-    fwrite("\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0prefix\0", 28, 1, f_target);
+    if (open_pbo_writer(&writer, args.positionals[2])) {
+        errorf("Failed to open %s.\n", args.positionals[2]);
+        remove_folder(tempfolder);
+        return 2;
+    }
+    pbo_write(&writer, "\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 21);
+    pbo_write_extension(&writer, "prefix");
     // write addonprefix with windows pathseps
     for (i = 0; i <= strlen(addonprefix); i++) {
         if (addonprefix[i] == PATHSEP)
-            fputc('\\', f_target);
+            windows_prefix[i] = '\\';
         else
-            fputc(addonprefix[i], f_target);
+            windows_prefix[i] = addonprefix[i];
     }
+    pbo_write_extension(&writer, windows_prefix);
     // write extra header extensions
     for (i = 0; i < args.num_headerextensions && args.headerextensions[i][0] != 0; i++) {
         k = 0;
@@ -391,14 +459,14 @@ int cmd_build() {
                 // validate
                 if (args.headerextensions[i][j] == '\0' && !valid) {
                     errorf("Invalid header extension format (%s).\n", args.headerextensions[i]);
+                    free_pbo_writer(&writer);
                     remove_file(args.positionals[2]);
                     remove_folder(tempfolder);
                     return 6;
                 }
 
                 // write
-                fputs(buffer, f_target);
-                fputc(0, f_target);
+                pbo_write_extension(&writer, buffer);
                 k = 0;
                 valid = true;
             } else {
@@ -407,32 +475,30 @@ int cmd_build() {
             }
         }
     }
-    fputc(0, f_target);
-    fclose(f_target);
+    pbo_write_extension(&writer, "");
 
     // write headers to file
-    if (traverse_directory(tempfolder, write_header_to_pbo, args.positionals[2])) {
+    if (traverse_directory(tempfolder, write_header_to_pbo, (char *)&writer)) {
         errorf("Failed to write some file header(s) to PBO.\n");
+        free_pbo_writer(&writer);
         remove_file(args.positionals[2]);
         remove_folder(tempfolder);
         return 7;
     }
 
     // header boundary
-    f_target = fopen(args.positionals[2], "ab");
-    if (!f_target) {
+    if (pbo_write(&writer, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 21)) {
         errorf("Failed to write header boundary to PBO.\n");
+        free_pbo_writer(&writer);
         remove_file(args.positionals[2]);
         remove_folder(tempfolder);
         return 8;
     }
-    for (i = 0; i < 21; i++)
-        fputc(0, f_target);
-    fclose(f_target);
 
     // write contents to file
-    if (traverse_directory(tempfolder, write_data_to_pbo, args.positionals[2])) {
+    if (traverse_directory(tempfolder, write_data_to_pbo, (char *)&writer)) {
         errorf("Failed to pack some file(s) into the PBO.\n");
+        free_pbo_writer(&writer);
         remove_file(args.positionals[2]);
         remove_folder(tempfolder);
         return 9;
@@ -440,21 +506,21 @@ int cmd_build() {
 
     // write checksum to file
     unsigned char checksum[20];
-    hash_file(args.positionals[2], checksum);
-    f_target = fopen(args.positionals[2], "ab");
-    if (!f_target) {
+    sha1_final(&writer.checksum, checksum);
+    if (fputc(0, writer.f) == EOF || fwrite(checksum, 20, 1, writer.f) != 1 || fclose(writer.f)) {
+        writer.f = NULL;
         errorf("Failed to write checksum to file.\n");
+        free_pbo_writer(&writer);
         remove_file(args.positionals[2]);
         remove_folder(tempfolder);
         return 10;
     }
-    fputc(0, f_target);
-    fwrite(checksum, 20, 1, f_target);
-    fclose(f_target);
+    writer.f = NULL;
 
     // remove temp folder
     if (remove_folder(tempfolder)) {
         errorf("Failed to remove temp folder.\n");
+        free_pbo_writer(&writer);
         return 11;
     }
 
@@ -465,6 +531,7 @@ int cmd_build() {
 
         if (strcmp(strrchr(args.privatekey, '.'), ".biprivatekey") != 0) {
             errorf("File %s doesn't seem to be a valid private key.\n", args.positionals[1]);
+            free_pbo_writer(&writer);
             return 1;
         }
 
@@ -488,14 +555,36 @@ int cmd_build() {
         // check if target already exists
         if (access(path_signature, F_OK) != -1 && !args.force) {
             errorf("File %s already exists and --force was not set.\n", path_signature);
+            free_pbo_writer(&writer);
             return 2;
         }
 
-        if (sign_pbo(args.positionals[2], args.privatekey, path_signature)) {
+        // everything but the name hash was gathered while writing
+        unsigned char namehash[20];
+        unsigned char filehash[20];
+        if (writer.nothing)
+            sha1_update(&writer.filehash, (unsigned char *)"nothing", strlen("nothing"));
+
+        struct private_key key;
+        if (read_private_key(args.privatekey, &key)) {
+            errorf("Failed to read private key %s.\n", args.privatekey);
+            free_pbo_writer(&writer);
+            return 3;
+        }
+
+        if (name_hash(writer.names, writer.num_names, namehash) ||
+                sha1_final(&writer.filehash, filehash) ||
+                sign_hashes(checksum, namehash, filehash, writer.prefix, &key, path_signature)) {
             errorf("Failed to sign file.\n");
+            free_private_key(&key);
+            free_pbo_writer(&writer);
             return 3;
         }
+
+        free_private_key(&key);
     }
 
+    free_pbo_writer(&writer);
+
     return 0;
 }
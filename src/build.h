@@ -19,4 +19,41 @@
 #pragma once
 
 
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "hash.h"
+
+
+struct pbo_writer {
+    FILE *f;
+    struct sha1 checksum;
+    struct sha1 filehash;
+    bool nothing;
+    char **names;
+    int num_names;
+    char prefix[512];
+    char last_extension[512];
+    bool extensions_done;
+};
+
+
+bool file_allowed(char *filename);
+
+int binarize_callback(char *root, char *source, char *junk);
+
+int open_pbo_writer(struct pbo_writer *writer, char *path);
+
+void free_pbo_writer(struct pbo_writer *writer);
+
+int pbo_write(struct pbo_writer *writer, const void *data, size_t size);
+
+int pbo_write_extension(struct pbo_writer *writer, char *string);
+
+void get_pbo_name(char *root, char *source, char *filename);
+
+int write_header_to_pbo(char *root, char *source, char *data);
+
+int write_data_to_pbo(char *root, char *source, char *data);
+
 int cmd_build();
@@ -642,6 +642,369 @@ int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffs
 }
 
 
+struct definition *find_config_entry(struct class *class, char *config_path) {
+    /*
+     * Looks up the class or value at the given config path in a parsed
+     * class tree, like seek_config_path does in a rapified file (case
+     * insensitive, extern and delete statements don't count).
+     *
+     * Returns NULL if the given path doesn't exist.
+     */
+
+    struct definition *tmp;
+    char path[2048];
+    char *target;
+    char *next;
+    char *end;
+    char *name;
+
+    strncpy(path, config_path, sizeof(path));
+    path[sizeof(path) - 1] = 0;
+
+    for (target = path; target != NULL; target = next) {
+        next = strstr(target, ">>");
+        if (next != NULL) {
+            *next = 0;
+            next += 2;
+        }
+
+        // trim in place, trim() would pad over the following elements
+        while (*target == ' ' || *target == '\t')
+            target++;
+        for (end = target + strlen(target); end > target && (*(end - 1) == ' ' || *(end - 1) == '\t'); end--)
+            *(end - 1) = 0;
+
+        if (class->content == NULL)
+            return NULL;
+
+        for (tmp = class->content->head; tmp != NULL; tmp = tmp->next) {
+            if (tmp->type == TYPE_CLASS) {
+                if (((struct class *)tmp->content)->content == NULL)
+                    continue;
+                name = ((struct class *)tmp->content)->name;
+            } else {
+                if (((struct variable *)tmp->content)->type == TYPE_ARRAY_EXPANSION)
+                    continue;
+                name = ((struct variable *)tmp->content)->name;
+            }
+
+            if (stricmp(name, target) == 0)
+                break;
+        }
+
+        if (tmp == NULL)
+            return NULL;
+
+        if (next == NULL)
+            return tmp;
+
+        if (tmp->type != TYPE_CLASS)
+            return NULL;
+
+        class = (struct class *)tmp->content;
+    }
+
+    return NULL;
+}
+
+
+int find_config_parent(struct class *root, char *config_path, char *buffer, size_t buffsize) {
+    /*
+     * Takes a config path and returns the parent class of that class, the
+     * same way find_parent does in a rapified file.
+     *
+     * Returns -1 if the class doesn't have a parent class, -2 if that
+     * class cannot be found, 0 on success and a positive integer
+     * on failure.
+     */
+
+    int i;
+    int success;
+    bool is_root;
+    struct definition *definition;
+    char containing[2048];
+    char name[2048];
+    char parent[2048];
+
+    // Loop up class
+    definition = find_config_entry(root, config_path);
+    if (definition == NULL || definition->type != TYPE_CLASS)
+        return 1;
+
+    // Get parent class name
+    if (((struct class *)definition->content)->parent == NULL)
+        return -1;
+
+    strncpy(parent, ((struct class *)definition->content)->parent, sizeof(parent));
+    lower_case(parent);
+
+    if (strlen(parent) == 0)
+        return -1;
+
+    // Extract class name and the name of the containing class
+    is_root = strchr(config_path, '>') == NULL;
+    if (is_root) {
+        strncpy(name, config_path, sizeof(name));
+        containing[0] = 0;
+    } else {
+        strncpy(name, strrchr(config_path, '>') + 1, sizeof(name));
+        trim_leading(name, sizeof(name));
+        strncpy(containing, config_path, sizeof(containing));
+        *(strrchr(containing, '>') - 1) = 0;
+        for (i = strlen(containing) - 1; i >= 0 && containing[i] == ' '; i--)
+            containing[i] = 0;
+    }
+
+    lower_case(name);
+
+    // Check parent class inside same containing class
+    if (strcmp(name, parent) != 0) {
+        sprintf(buffer, "%s >> %s", containing, parent);
+        if (find_config_entry(root, buffer) != NULL)
+            return 0;
+    }
+
+    // If this is a root class, we can't do anything at this point
+    if (is_root)
+        return -2;
+
+    // Try to find the class parent in the parent of the containing class
+    success = find_config_parent(root, containing, buffer, buffsize);
+    if (success > 0)
+        return success;
+    if (success < 0)
+        return -2;
+
+    strcat(buffer, " >> ");
+    strcat(buffer, parent);
+
+    return 0;
+}
+
+
+struct definition *find_config_definition(struct class *root, char *config_path) {
+    /*
+     * Finds the definition of the given value in a parsed class tree, even
+     * if it is defined in a parent class.
+     *
+     * Returns NULL if the value could not be found.
+     */
+
+    int i;
+    struct definition *definition;
+    char containing[2048];
+    char parent[2048];
+    char value[2048];
+
+    // Try the direct way first
+    definition = find_config_entry(root, config_path);
+    if (definition != NULL)
+        return definition;
+
+    // No containing class
+    if (strchr(config_path, '>') == NULL)
+        return NULL;
+
+    // Find parent of the containing class
+    strncpy(containing, config_path, sizeof(containing));
+    *(strrchr(containing, '>') - 1) = 0;
+    for (i = strlen(containing) - 1; i >= 0 && containing[i] == ' '; i--)
+        containing[i] = 0;
+
+    if (find_config_parent(root, containing, parent, sizeof(parent)))
+        return NULL;
+
+    strncpy(value, strrchr(config_path, '>') + 1, sizeof(value));
+    trim_leading(value, sizeof(value));
+    strcat(parent, " >> ");
+    strcat(parent, value);
+
+    return find_config_definition(root, parent);
+}
+
+
+int read_config_string(struct class *root, char *config_path, char *buffer, size_t buffsize) {
+    /*
+     * Reads the given config string from a parsed class tree into the given
+     * buffer.
+     *
+     * Returns -1 if the value could not be found, 0 on success
+     * and a positive integer on failure.
+     */
+
+    struct definition *definition;
+    struct variable *variable;
+
+    definition = find_config_definition(root, config_path);
+    if (definition == NULL)
+        return -1;
+
+    variable = (struct variable *)definition->content;
+    if (definition->type != TYPE_VAR || variable->type != TYPE_VAR)
+        return 1;
+
+    if (variable->expression->type != TYPE_STRING)
+        return 2;
+
+    strncpy(buffer, variable->expression->string_value, buffsize - 1);
+    buffer[buffsize - 1] = 0;
+
+    return 0;
+}
+
+
+int read_config_int(struct class *root, char *config_path, int32_t *result) {
+    /*
+     * Reads the given integer from a parsed class tree.
+     *
+     * Returns -1 if the value could not be found, 0 on success
+     * and a positive integer on failure.
+     */
+
+    struct definition *definition;
+    struct variable *variable;
+
+    definition = find_config_definition(root, config_path);
+    if (definition == NULL)
+        return -1;
+
+    variable = (struct variable *)definition->content;
+    if (definition->type != TYPE_VAR || variable->type != TYPE_VAR)
+        return 1;
+
+    if (variable->expression->type != TYPE_INT)
+        return 2;
+
+    *result = variable->expression->int_value;
+
+    return 0;
+}
+
+
+int read_config_float(struct class *root, char *config_path, float *result) {
+    /*
+     * Reads the given float from a parsed class tree.
+     *
+     * Returns -1 if the value could not be found, 0 on success
+     * and a positive integer on failure.
+     */
+
+    struct definition *definition;
+    struct variable *variable;
+    char string_value[512];
+    char *endptr;
+
+    definition = find_config_definition(root, config_path);
+    if (definition == NULL)
+        return -1;
+
+    variable = (struct variable *)definition->content;
+    if (definition->type != TYPE_VAR || variable->type != TYPE_VAR)
+        return 1;
+
+    if (variable->expression->type == TYPE_INT) {
+        *result = (float)variable->expression->int_value;
+    } else if (variable->expression->type == TYPE_STRING) {
+        // Try to parse "rad X" strings
+        strncpy(string_value, variable->expression->string_value, sizeof(string_value) - 1);
+        string_value[sizeof(string_value) - 1] = 0;
+
+        trim_leading(string_value, sizeof(string_value));
+        lower_case(string_value);
+
+        if (strncmp(string_value, "rad ", 4) != 0)
+            return 3;
+
+        *result = strtof(string_value + 4, &endptr);
+        if (strlen(endptr) > 0)
+            return 4;
+
+        *result *= RAD2DEG;
+    } else {
+        *result = variable->expression->float_value;
+    }
+
+    return 0;
+}
+
+
+int read_config_string_array(struct class *root, char *config_path, char *buffer, int size, size_t buffsize) {
+    /*
+     * Reads the given array from a parsed class tree. size should be the
+     * maximum number of elements in the array, buffsize the length of the
+     * individual buffers.
+     *
+     * Returns -1 if the value could not be found, 0 on success
+     * and a positive integer on failure.
+     */
+
+    int i;
+    struct definition *definition;
+    struct variable *variable;
+    struct expression *tmp;
+
+    definition = find_config_definition(root, config_path);
+    if (definition == NULL)
+        return -1;
+
+    variable = (struct variable *)definition->content;
+    if (definition->type != TYPE_VAR || variable->type != TYPE_ARRAY)
+        return 1;
+
+    for (i = 0, tmp = variable->expression->head; tmp != NULL; i++, tmp = tmp->next) {
+        // Array is full
+        if (i == size)
+            return 2;
+
+        if (tmp->type != TYPE_STRING)
+            return 3;
+
+        strncpy(buffer + i * buffsize, tmp->string_value, buffsize - 1);
+        buffer[i * buffsize + buffsize - 1] = 0;
+    }
+
+    return 0;
+}
+
+
+int read_config_classes(struct class *root, char *config_path, char *array, int size, size_t buffsize) {
+    /*
+     * Reads all subclass names for the given config path in a parsed class
+     * tree into the given array.
+     *
+     * Returns a positive integer on failure, a 0 on success and -1
+     * if the given path doesn't exist.
+     */
+
+    int j;
+    struct definition *definition;
+    struct definition *tmp;
+
+    definition = find_config_entry(root, config_path);
+    if (definition == NULL)
+        return -1;
+
+    if (definition->type != TYPE_CLASS)
+        return 1;
+
+    for (tmp = ((struct class *)definition->content)->content->head; tmp != NULL; tmp = tmp->next) {
+        if (tmp->type != TYPE_CLASS || ((struct class *)tmp->content)->content == NULL)
+            continue;
+
+        for (j = 0; j < size; j++) {
+            if (*(array + j * buffsize) == 0)
+                break;
+        }
+        if (j == size)
+            return 2;
+
+        strncpy(array + j * buffsize, ((struct class *)tmp->content)->name, buffsize);
+    }
+
+    return 0;
+}
+
+
 int derapify_array(FILE *f_source, FILE *f_target) {
     char buffer[4096];
     uint32_t num_entries;
@@ -714,10 +1077,11 @@ int derapify_class(FILE *f_source, FILE *f_target, char *classname, int level) {
             strcat(indentation, "    ");
     }
 
+    // the root class isn't wrapped, there's no indentation to take off
     strcpy(indentation_wrapping, indentation);
-    if (args.indent)
+    if (level > 0 && args.indent)
         indentation_wrapping[strlen(indentation_wrapping) - strlen(args.indent)] = 0;
-    else
+    else if (level > 0)
         indentation_wrapping[strlen(indentation_wrapping) - 4] = 0;
 
     if (strlen(classname) == 0) {
@@ -19,6 +19,9 @@
 #pragma once
 
 
+#include "rapify.h"
+
+
 #define RAD2DEG 0.017453293;
 
 
@@ -42,6 +45,22 @@ int read_string_array(FILE *f, char *config_path, char *buffer, int size, size_t
 
 int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffsize);
 
+struct definition *find_config_entry(struct class *class, char *config_path);
+
+int find_config_parent(struct class *root, char *config_path, char *buffer, size_t buffsize);
+
+struct definition *find_config_definition(struct class *root, char *config_path);
+
+int read_config_string(struct class *root, char *config_path, char *buffer, size_t buffsize);
+
+int read_config_int(struct class *root, char *config_path, int32_t *result);
+
+int read_config_float(struct class *root, char *config_path, float *result);
+
+int read_config_string_array(struct class *root, char *config_path, char *buffer, int size, size_t buffsize);
+
+int read_config_classes(struct class *root, char *config_path, char *array, int size, size_t buffsize);
+
 int derapify_file(char *source, char *target);
 
 int cmd_derapify();
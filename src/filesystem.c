@@ -26,6 +26,7 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <wchar.h>
+#include <sys/stat.h>
 #else
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -38,6 +39,7 @@
 #endif
 
 #include "filesystem.h"
+#include "threads.h"
 #include "utils.h"
 
 
@@ -480,3 +482,190 @@ int copy_directory(char *source, char *target) {
 
     return traverse_directory(source, copy_callback, target);
 }
+
+
+bool needs_update(char *source, char *target) {
+    /*
+     * Checks whether the target file is missing or older than the source
+     * file.
+     */
+
+    struct stat st_source;
+    struct stat st_target;
+
+    if (stat(target, &st_target) != 0)
+        return true;
+    if (stat(source, &st_source) != 0)
+        return true;
+
+    return st_source.st_mtime > st_target.st_mtime;
+}
+
+
+int compare_paths(char *a, char *b) {
+    /*
+     * Compares two target paths the way the filesystem does, so paths
+     * differing only in case are the same file on Windows and macOS.
+     */
+
+#if defined(_WIN32) || defined(__APPLE__)
+    return stricmp(a, b);
+#else
+    return strcmp(a, b);
+#endif
+}
+
+
+int batch_callback(char *source_root, char *source, char *data) {
+    /*
+     * Traversal callback for convert_directory. Queues the file for
+     * conversion if it has one of the source extensions and its target is
+     * out of date.
+     */
+
+    struct batch_conversion *batch = (struct batch_conversion *)data;
+    struct conversion *conversion;
+    char target[2048];
+    char *extension;
+    int i;
+
+    extension = strrchr(source, '.');
+    if (extension == NULL || strchr(extension, PATHSEP) != NULL)
+        return 0;
+
+    for (i = 0; batch->extensions[i] != NULL; i++) {
+        if (stricmp(extension + 1, batch->extensions[i]) == 0)
+            break;
+    }
+    if (batch->extensions[i] == NULL)
+        return 0;
+
+    if (strlen(batch->target_root) + (extension - source) - strlen(source_root) + strlen(batch->target_extension) + 2 > sizeof(target))
+        return -1;
+
+    target[0] = 0;
+    strcat(target, batch->target_root);
+    strncat(target, source + strlen(source_root), extension - source - strlen(source_root));
+    strcat(target, ".");
+    strcat(target, batch->target_extension);
+
+    if (!batch->force && !needs_update(source, target))
+        return 0;
+
+    if (batch->num_conversions % CONVERSIONINTERVAL == 0)
+        batch->conversions = (struct conversion *)safe_realloc(batch->conversions,
+            sizeof(struct conversion) * (batch->num_conversions + CONVERSIONINTERVAL));
+
+    conversion = &batch->conversions[batch->num_conversions++];
+    strncpy(conversion->source, source, sizeof(conversion->source) - 1);
+    conversion->source[sizeof(conversion->source) - 1] = 0;
+    strcpy(conversion->target, target);
+
+    return 0;
+}
+
+
+int batch_task(int index, void *data) {
+    struct batch_conversion *batch = (struct batch_conversion *)data;
+    struct conversion *conversion = &batch->conversions[index];
+    int success;
+
+    success = batch->convert(conversion->source, conversion->target);
+    if (success)
+        errorf("Failed to convert %s.\n", conversion->source);
+
+    return success;
+}
+
+
+int conversion_sort(const void *av, const void *bv) {
+    /*
+     * Compares two conversions by their targets, conversions with the same
+     * target by their sources.
+     */
+
+    struct conversion *a = (struct conversion *)av;
+    struct conversion *b = (struct conversion *)bv;
+    int result;
+
+    result = compare_paths(a->target, b->target);
+    if (result != 0)
+        return result;
+
+    return strcmp(a->source, b->source);
+}
+
+
+int convert_directory(char *source, char *target, char **extensions, char *target_extension,
+        bool force, int (*convert)(char *, char *)) {
+    /*
+     * Converts every file in the source directory with one of the given
+     * (NULL-terminated) extensions into the same relative path in the
+     * target directory, with the extension replaced by target_extension.
+     * Files whose target is newer than the source are skipped unless force
+     * is set. The conversions are spread across threads, so convert has to
+     * be safe to call concurrently.
+     *
+     * Returns 0 on success, a positive integer on traversal failure and the
+     * result of the first failed conversion otherwise.
+     */
+
+    struct batch_conversion batch;
+    char folder[2048];
+    int success;
+    int i;
+    int j;
+
+    // Remove trailing path seperators
+    if (source[strlen(source) - 1] == PATHSEP)
+        source[strlen(source) - 1] = 0;
+    if (target[strlen(target) - 1] == PATHSEP)
+        target[strlen(target) - 1] = 0;
+
+    batch.target_root = target;
+    batch.extensions = extensions;
+    batch.target_extension = target_extension;
+    batch.force = force;
+    batch.convert = convert;
+    batch.num_conversions = 0;
+    batch.conversions = NULL;
+
+    success = traverse_directory(source, batch_callback, (char *)&batch);
+    if (success) {
+        errorf("Failed to read folder %s.\n", source);
+        free(batch.conversions);
+        return success > 0 ? success : 1;
+    }
+
+    // Sources differing only in extension share a target, only convert the first one
+    qsort(batch.conversions, batch.num_conversions, sizeof(struct conversion), conversion_sort);
+
+    for (i = 0, j = 0; i < batch.num_conversions; i++) {
+        if (j > 0 && compare_paths(batch.conversions[j - 1].target, batch.conversions[i].target) == 0) {
+            warningf("%s and %s have the same target, skipping %s.\n",
+                batch.conversions[j - 1].source, batch.conversions[i].source, batch.conversions[i].source);
+            continue;
+        }
+        if (i != j)
+            batch.conversions[j] = batch.conversions[i];
+        j++;
+    }
+    batch.num_conversions = j;
+
+    // Create the target folders up front, so the conversions don't race for them
+    for (i = 0; i < batch.num_conversions; i++) {
+        strcpy(folder, batch.conversions[i].target);
+        *strrchr(folder, PATHSEP) = 0;
+        if (create_folders(folder)) {
+            errorf("Failed to create folder %s.\n", folder);
+            free(batch.conversions);
+            return 2;
+        }
+    }
+
+    success = parallel_for(batch.num_conversions, batch_task, &batch);
+
+    free(batch.conversions);
+
+    return success;
+}
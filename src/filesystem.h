@@ -19,6 +19,9 @@
 #pragma once
 
 
+#include <stdbool.h>
+
+
 #ifdef _WIN32
 #define PATHSEP '\\'
 #define PATHSEP_STR "\\"
@@ -29,6 +32,24 @@
 #define TEMPPATH "/tmp/armake/"
 #endif
 
+#define CONVERSIONINTERVAL 64
+
+
+struct conversion {
+    char source[2048];
+    char target[2048];
+};
+
+struct batch_conversion {
+    char *target_root;
+    char **extensions;
+    char *target_extension;
+    bool force;
+    int (*convert)(char *, char *);
+    int num_conversions;
+    struct conversion *conversions;
+};
+
 
 #ifdef _WIN32
 ssize_t getdelim(char **buf, size_t *bufsiz, int delimiter, FILE *fp);
@@ -54,3 +75,16 @@ int traverse_directory(char *root, int (*callback)(char *, char *, char *),
     char *third_arg);
 
 int copy_directory(char *source, char *target);
+
+bool needs_update(char *source, char *target);
+
+int compare_paths(char *a, char *b);
+
+int batch_callback(char *source_root, char *source, char *data);
+
+int batch_task(int index, void *data);
+
+int conversion_sort(const void *av, const void *bv);
+
+int convert_directory(char *source, char *target, char **extensions, char *target_extension,
+    bool force, int (*convert)(char *, char *));
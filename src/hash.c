@@ -0,0 +1,116 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <openssl/evp.h>
+
+#include "sha1.h"
+#include "hash.h"
+
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+
+int sha1_backend = SHA1_BACKEND_OPENSSL;
+
+
+int sha1_init(struct sha1 *sha) {
+    /*
+     * Starts a SHA1 computation. OpenSSL's implementation picks the fastest
+     * code path for the CPU (including the SHA extensions), so it is
+     * preferred over the portable one in lib/sha1.c, which is only used if
+     * OpenSSL can't provide SHA1 or the portable backend was requested.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    memset(sha, 0, sizeof(struct sha1));
+    sha->backend = sha1_backend;
+
+    if (sha->backend == SHA1_BACKEND_OPENSSL) {
+        sha->evp = EVP_MD_CTX_new();
+        if (sha->evp != NULL && EVP_DigestInit_ex(sha->evp, EVP_sha1(), NULL) == 1)
+            return 0;
+
+        sha1_free(sha);
+        sha->backend = SHA1_BACKEND_PORTABLE;
+    }
+
+    SHA1Reset(&sha->portable);
+
+    return 0;
+}
+
+
+void sha1_update(struct sha1 *sha, const void *data, size_t length) {
+    const unsigned char *ptr = (const unsigned char *)data;
+    size_t chunk;
+
+    if (sha->backend == SHA1_BACKEND_OPENSSL) {
+        EVP_DigestUpdate(sha->evp, data, length);
+        return;
+    }
+
+    while (length > 0) {
+        chunk = (length > UINT_MAX) ? UINT_MAX : length;
+        SHA1Input(&sha->portable, ptr, chunk);
+        ptr += chunk;
+        length -= chunk;
+    }
+}
+
+
+int sha1_final(struct sha1 *sha, unsigned char hash[20]) {
+    /*
+     * Finishes a SHA1 computation, stores the digest in byte order and
+     * releases the context.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    int i;
+    int success;
+
+    if (sha->backend == SHA1_BACKEND_OPENSSL) {
+        success = EVP_DigestFinal_ex(sha->evp, hash, NULL) != 1;
+        sha1_free(sha);
+        return success;
+    }
+
+    if (!SHA1Result(&sha->portable))
+        return 1;
+
+    for (i = 0; i < 20; i++)
+        hash[i] = (sha->portable.Message_Digest[i / 4] >> (24 - 8 * (i % 4))) & 0xff;
+
+    return 0;
+}
+
+
+void sha1_free(struct sha1 *sha) {
+    if (sha->evp != NULL)
+        EVP_MD_CTX_free(sha->evp);
+    sha->evp = NULL;
+}
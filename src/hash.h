@@ -0,0 +1,49 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stddef.h>
+#include <openssl/evp.h>
+
+#include "sha1.h"
+
+
+#define SHA1_BACKEND_OPENSSL 0
+#define SHA1_BACKEND_PORTABLE 1
+
+
+struct sha1 {
+    int backend;
+    EVP_MD_CTX *evp;
+    SHA1Context portable;
+};
+
+
+// backend used for new hashes, falls back to the portable one if OpenSSL fails
+extern int sha1_backend;
+
+
+int sha1_init(struct sha1 *sha);
+
+void sha1_update(struct sha1 *sha, const void *data, size_t length);
+
+int sha1_final(struct sha1 *sha, unsigned char hash[20]);
+
+void sha1_free(struct sha1 *sha);
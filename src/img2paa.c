@@ -32,8 +32,20 @@
 #include <windows.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_FAILURE_STRINGS // the failure reason is a global, which isn't thread safe
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function" // stbi__err is unused without failure strings
+#endif
 #include "stb_image.h"
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image_resize.h"
 #define STB_DXT_IMPLEMENTATION
@@ -42,39 +54,404 @@
 
 #include "args.h"
 #include "utils.h"
+#include "filesystem.h"
+#include "threads.h"
+#include "lzss.h"
+#include "lzo.h"
 #include "paa2img.h"
 #include "img2paa.h"
 
 
-int img2dxt1(unsigned char *input, unsigned char *output, int width, int height) {
+void dxt_bounding_box(unsigned char *block, unsigned char min[4], unsigned char max[4]) {
     /*
-     * Converts image data to DXT1 data.
-     *
-     * Returns 0 on success and a positive integer on failure.
+     * Finds the per-channel minimum and maximum of a 4x4 RGBA block.
      */
 
-    unsigned char img_block[64];
-    unsigned char dxt_block[8];
+#ifdef __SSE2__
+    __m128i v0, v1, v2, v3;
+    __m128i vmin, vmax;
+    uint32_t packed;
+    int i;
+
+    v0 = _mm_loadu_si128((__m128i *)(block +  0));
+    v1 = _mm_loadu_si128((__m128i *)(block + 16));
+    v2 = _mm_loadu_si128((__m128i *)(block + 32));
+    v3 = _mm_loadu_si128((__m128i *)(block + 48));
+
+    vmin = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+    vmax = _mm_max_epu8(_mm_max_epu8(v0, v1), _mm_max_epu8(v2, v3));
+
+    vmin = _mm_min_epu8(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmin = _mm_min_epu8(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(2, 3, 0, 1)));
+    vmax = _mm_max_epu8(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = _mm_max_epu8(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    packed = (uint32_t)_mm_cvtsi128_si32(vmin);
+    for (i = 0; i < 4; i++)
+        min[i] = (packed >> (8 * i)) & 0xff;
+
+    packed = (uint32_t)_mm_cvtsi128_si32(vmax);
+    for (i = 0; i < 4; i++)
+        max[i] = (packed >> (8 * i)) & 0xff;
+#else
+    int i;
+    int j;
+
+    memset(min, 0xff, 4);
+    memset(max, 0, 4);
+
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 4; j++) {
+            min[j] = MIN(min[j], block[i * 4 + j]);
+            max[j] = MAX(max[j], block[i * 4 + j]);
+        }
+    }
+#endif
+}
+
+
+uint32_t dxt_color_indices(unsigned char *block, unsigned char colors[4][4]) {
+    /*
+     * Picks the closest palette entry for every pixel of the block, using
+     * the sum of absolute channel differences, and packs the 2-bit indices.
+     * The comparison network maps the distances straight to DXT index
+     * order (color0, color1, 2/3 color0, 1/3 color0).
+     */
+
+#ifdef __SSE2__
+    __m128i palette[4];
+    __m128i pixels, diff, d[4];
+    __m128i b0, b1, b2, b3, b4;
+    __m128i x0, x1, x2;
+    __m128i index;
+    __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+    __m128i byte_mask = _mm_set1_epi32(0xff);
+    __m128i shifts = _mm_set_epi32(64, 16, 4, 1);
+    uint32_t indices = 0;
     int i;
     int j;
 
-    for (i = 0; i < height; i += 4) {
-        for (j = 0; j < width; j += 4) {
-            memcpy(img_block +  0, input + (i + 0) * width * 4 + j * 4, 16);
-            memcpy(img_block + 16, input + (i + 1) * width * 4 + j * 4, 16);
-            memcpy(img_block + 32, input + (i + 2) * width * 4 + j * 4, 16);
-            memcpy(img_block + 48, input + (i + 3) * width * 4 + j * 4, 16);
+    for (j = 0; j < 4; j++)
+        palette[j] = _mm_set1_epi32(colors[j][0] | (colors[j][1] << 8) | (colors[j][2] << 16));
+
+    for (i = 0; i < 4; i++) {
+        pixels = _mm_loadu_si128((__m128i *)(block + i * 16));
+
+        for (j = 0; j < 4; j++) {
+            diff = _mm_or_si128(_mm_subs_epu8(pixels, palette[j]), _mm_subs_epu8(palette[j], pixels));
+            diff = _mm_and_si128(diff, rgb_mask);
+            d[j] = _mm_add_epi32(_mm_and_si128(diff, byte_mask), _mm_and_si128(_mm_srli_epi32(diff, 8), byte_mask));
+            d[j] = _mm_add_epi32(d[j], _mm_srli_epi32(diff, 16));
+        }
+
+        b0 = _mm_cmpgt_epi32(d[0], d[3]);
+        b1 = _mm_cmpgt_epi32(d[1], d[2]);
+        b2 = _mm_cmpgt_epi32(d[0], d[2]);
+        b3 = _mm_cmpgt_epi32(d[1], d[3]);
+        b4 = _mm_cmpgt_epi32(d[2], d[3]);
+
+        x0 = _mm_and_si128(b1, b2);
+        x1 = _mm_and_si128(b0, b3);
+        x2 = _mm_and_si128(b0, b4);
+
+        index = _mm_or_si128(_mm_and_si128(x2, _mm_set1_epi32(1)),
+                _mm_and_si128(_mm_or_si128(x0, x1), _mm_set1_epi32(2)));
 
-            stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, 0, STB_DXT_HIGHQUAL);
+        // shift each pixel's index into place, then OR the four lanes together
+        index = _mm_mullo_epi16(index, shifts);
+        index = _mm_or_si128(index, _mm_srli_si128(index, 8));
+        index = _mm_or_si128(index, _mm_srli_si128(index, 4));
 
-            memcpy(output + (i / 4) * (width / 4) * sizeof(dxt_block) + (j / 4) * sizeof(dxt_block), dxt_block, sizeof(dxt_block));
+        indices |= ((uint32_t)_mm_cvtsi128_si32(index) & 0xff) << (8 * i);
+    }
+
+    return indices;
+#else
+    uint32_t indices = 0;
+    int d[4];
+    int b0, b1, b2, b3, b4;
+    int x0, x1, x2;
+    int i;
+    int j;
+
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 4; j++) {
+            d[j] = abs(block[i * 4 + 0] - colors[j][0]) +
+                abs(block[i * 4 + 1] - colors[j][1]) +
+                abs(block[i * 4 + 2] - colors[j][2]);
         }
+
+        b0 = d[0] > d[3];
+        b1 = d[1] > d[2];
+        b2 = d[0] > d[2];
+        b3 = d[1] > d[3];
+        b4 = d[2] > d[3];
+
+        x0 = b1 & b2;
+        x1 = b0 & b3;
+        x2 = b0 & b4;
+
+        indices |= (uint32_t)(x2 | ((x0 | x1) << 1)) << (2 * i);
+    }
+
+    return indices;
+#endif
+}
+
+
+void dxt_alpha_indices(unsigned char *block, int thresholds[7], unsigned char indices[16]) {
+    /*
+     * Picks the closest entry of the DXT5 alpha palette for every pixel.
+     * thresholds holds the sums of neighbouring palette values in ascending
+     * order, so counting how many of them 2 * alpha exceeds gives the
+     * position in the sorted palette, which is then mapped to DXT order.
+     */
+
+#ifdef __SSE2__
+    __m128i alpha[2];
+    __m128i position;
+    __m128i index;
+    uint16_t values[8];
+    int i;
+    int j;
+
+    alpha[0] = _mm_packs_epi32(
+        _mm_srli_epi32(_mm_loadu_si128((__m128i *)(block +  0)), 24),
+        _mm_srli_epi32(_mm_loadu_si128((__m128i *)(block + 16)), 24));
+    alpha[1] = _mm_packs_epi32(
+        _mm_srli_epi32(_mm_loadu_si128((__m128i *)(block + 32)), 24),
+        _mm_srli_epi32(_mm_loadu_si128((__m128i *)(block + 48)), 24));
+
+    for (i = 0; i < 2; i++) {
+        alpha[i] = _mm_slli_epi16(alpha[i], 1);
+
+        position = _mm_setzero_si128();
+        for (j = 0; j < 7; j++)
+            position = _mm_sub_epi16(position, _mm_cmpgt_epi16(alpha[i], _mm_set1_epi16(thresholds[j])));
+
+        index = _mm_and_si128(_mm_sub_epi16(_mm_set1_epi16(8), position), _mm_set1_epi16(7));
+        index = _mm_xor_si128(index, _mm_and_si128(_mm_cmpgt_epi16(_mm_set1_epi16(2), index), _mm_set1_epi16(1)));
+
+        _mm_storeu_si128((__m128i *)values, index);
+        for (j = 0; j < 8; j++)
+            indices[i * 8 + j] = values[j];
+    }
+#else
+    int position;
+    int index;
+    int i;
+    int j;
+
+    for (i = 0; i < 16; i++) {
+        position = 0;
+        for (j = 0; j < 7; j++)
+            position += (2 * block[i * 4 + 3] > thresholds[j]);
+
+        index = (8 - position) & 7;
+        indices[i] = index ^ (index < 2);
+    }
+#endif
+}
+
+
+void compress_dxt_block_fast(unsigned char *dest, unsigned char *block, int alpha) {
+    /*
+     * Compresses a 4x4 RGBA block to DXT1 (alpha = 0, 8 bytes) or DXT5
+     * (alpha = 1, 16 bytes) using the inset bounding box of the block as
+     * endpoints. Much faster than stb_dxt's high quality mode, at the cost
+     * of some quality on noisy blocks. The SSE2 and plain C paths produce
+     * identical output.
+     */
+
+    unsigned char min[4];
+    unsigned char max[4];
+    unsigned char colors[4][4];
+    unsigned char alpha_indices[16];
+    unsigned char sorted[8];
+    int thresholds[7];
+    uint16_t color0;
+    uint16_t color1;
+    uint32_t indices;
+    uint64_t packed;
+    int inset;
+    int i;
+
+    dxt_bounding_box(block, min, max);
+
+    if (alpha) {
+        inset = (max[3] - min[3]) >> 5;
+        min[3] += inset;
+        max[3] -= inset;
+
+        // palette in ascending order: alpha1, interpolated values, alpha0
+        for (i = 0; i < 8; i++)
+            sorted[i] = (i * max[3] + (7 - i) * min[3]) / 7;
+        for (i = 0; i < 7; i++)
+            thresholds[i] = sorted[i] + sorted[i + 1];
+
+        dxt_alpha_indices(block, thresholds, alpha_indices);
+
+        packed = 0;
+        for (i = 0; i < 16; i++)
+            packed |= (uint64_t)alpha_indices[i] << (3 * i);
+
+        dest[0] = max[3];
+        dest[1] = min[3];
+        for (i = 0; i < 6; i++)
+            dest[2 + i] = (packed >> (8 * i)) & 0xff;
+
+        dest += 8;
+    }
+
+    for (i = 0; i < 3; i++) {
+        inset = (max[i] - min[i]) >> 4;
+        min[i] += inset;
+        max[i] -= inset;
+    }
+
+    color0 = ((max[0] >> 3) << 11) | ((max[1] >> 2) << 5) | (max[2] >> 3);
+    color1 = ((min[0] >> 3) << 11) | ((min[1] >> 2) << 5) | (min[2] >> 3);
+
+    // palette as the decoder will see it, after the round trip through 565
+    colors[0][0] = ((color0 >> 11) << 3) | (color0 >> 13);
+    colors[0][1] = (((color0 >> 5) & 0x3f) << 2) | ((color0 >> 9) & 0x03);
+    colors[0][2] = ((color0 & 0x1f) << 3) | ((color0 >> 2) & 0x07);
+    colors[1][0] = ((color1 >> 11) << 3) | (color1 >> 13);
+    colors[1][1] = (((color1 >> 5) & 0x3f) << 2) | ((color1 >> 9) & 0x03);
+    colors[1][2] = ((color1 & 0x1f) << 3) | ((color1 >> 2) & 0x07);
+
+    for (i = 0; i < 3; i++) {
+        colors[2][i] = (2 * colors[0][i] + colors[1][i]) / 3;
+        colors[3][i] = (colors[0][i] + 2 * colors[1][i]) / 3;
+    }
+
+    /*
+     * Since max >= min in every channel, color0 >= color1. If they are
+     * equal, all distances are equal as well and every index is 0, so the
+     * three-color mode of DXT1 is never hit.
+     */
+    indices = dxt_color_indices(block, colors);
+
+    dest[0] = color0 & 0xff;
+    dest[1] = color0 >> 8;
+    dest[2] = color1 & 0xff;
+    dest[3] = color1 >> 8;
+    for (i = 0; i < 4; i++)
+        dest[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+
+int compress_dxt_row(int row, void *data) {
+    /*
+     * Compresses one row of 4x4 blocks, described by a dxt_job. Rows are
+     * independent of each other, so they can be compressed in any order.
+     * Blocks sticking out of the image (small mips) repeat its last
+     * column and row.
+     *
+     * Returns 0.
+     */
+
+    struct dxt_job *job = (struct dxt_job *)data;
+    unsigned char img_block[64];
+    unsigned char dxt_block[16];
+    unsigned char *input;
+    unsigned char *output;
+    int stride;
+    int j;
+    int x;
+    int y;
+
+    stride = job->width * 4;
+    input = job->input + row * 4 * stride;
+    output = job->output + row * ((job->width + 3) / 4) * job->block_size;
+
+    for (j = 0; j < job->width; j += 4) {
+        if (j + 4 <= job->width && row * 4 + 4 <= job->height) {
+            memcpy(img_block +  0, input + 0 * stride + j * 4, 16);
+            memcpy(img_block + 16, input + 1 * stride + j * 4, 16);
+            memcpy(img_block + 32, input + 2 * stride + j * 4, 16);
+            memcpy(img_block + 48, input + 3 * stride + j * 4, 16);
+        } else {
+            for (y = 0; y < 4; y++) {
+                for (x = 0; x < 4; x++)
+                    memcpy(img_block + (y * 4 + x) * 4, input + MIN(y, job->height - row * 4 - 1) * stride + MIN(j + x, job->width - 1) * 4, 4);
+            }
+        }
+
+        if (job->fast)
+            compress_dxt_block_fast(dxt_block, img_block, job->alpha);
+        else
+            stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, job->alpha, STB_DXT_HIGHQUAL);
+
+        memcpy(output + (j / 4) * job->block_size, dxt_block, job->block_size);
     }
 
     return 0;
 }
 
 
+void prepare_dxt() {
+    /*
+     * stb_dxt builds its lookup tables on first use, this has to happen
+     * before any threads exist.
+     */
+
+    unsigned char img_block[64];
+    unsigned char dxt_block[16];
+
+    memset(img_block, 0, sizeof(img_block));
+    stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, 0, STB_DXT_HIGHQUAL);
+}
+
+
+void init_dxt_job(struct dxt_job *job, unsigned char *input, unsigned char *output, int width, int height, int alpha) {
+    /*
+     * Sets up a job for compressing image data to DXT1 (alpha = 0) or DXT5
+     * (alpha = 1). Uses the fast bounding box encoder if "--quality fast"
+     * was passed, stb_dxt's high quality mode otherwise.
+     */
+
+    extern struct arguments args;
+
+    job->input = input;
+    job->output = output;
+    job->width = width;
+    job->height = height;
+    job->alpha = alpha;
+    job->block_size = alpha ? 16 : 8;
+    job->fast = args.quality != NULL && stricmp("fast", args.quality) == 0;
+
+    prepare_dxt();
+}
+
+
+int img2dxt(unsigned char *input, unsigned char *output, int width, int height, int alpha) {
+    /*
+     * Converts image data to DXT1 (alpha = 0) or DXT5 (alpha = 1) data,
+     * with the block rows split across threads.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct dxt_job job;
+
+    init_dxt_job(&job, input, output, width, height, alpha);
+
+    return parallel_for((height + 3) / 4, compress_dxt_row, &job);
+}
+
+
+int img2dxt1(unsigned char *input, unsigned char *output, int width, int height) {
+    /*
+     * Converts image data to DXT1 data.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    return img2dxt(input, output, width, height, 0);
+}
+
+
 int img2dxt5(unsigned char *input, unsigned char *output, int width, int height) {
     /*
      * Converts image data to DXT5 data.
@@ -82,60 +459,298 @@ int img2dxt5(unsigned char *input, unsigned char *output, int width, int height)
      * Returns 0 on success and a positive integer on failure.
      */
 
-    unsigned char img_block[64];
-    unsigned char dxt_block[16];
+    return img2dxt(input, output, width, height, 1);
+}
+
+
+int img2argb4444(unsigned char *input, unsigned char *output, int num_pixels) {
+    /*
+     * Converts image data to ARGB4444 data.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    uint16_t pixel;
     int i;
-    int j;
 
-    for (i = 0; i < height; i += 4) {
-        for (j = 0; j < width; j += 4) {
-            memcpy(img_block +  0, input + (i + 0) * width * 4 + j * 4, 16);
-            memcpy(img_block + 16, input + (i + 1) * width * 4 + j * 4, 16);
-            memcpy(img_block + 32, input + (i + 2) * width * 4 + j * 4, 16);
-            memcpy(img_block + 48, input + (i + 3) * width * 4 + j * 4, 16);
+    for (i = 0; i < num_pixels; i++) {
+        pixel = (((input[3] * 15 + 127) / 255) << 12) |
+            (((input[0] * 15 + 127) / 255) << 8) |
+            (((input[1] * 15 + 127) / 255) << 4) |
+            ((input[2] * 15 + 127) / 255);
 
-            stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, 1, STB_DXT_HIGHQUAL);
+        output[0] = pixel & 0xff;
+        output[1] = pixel >> 8;
 
-            memcpy(output + (i / 4) * (width / 4) * sizeof(dxt_block) + (j / 4) * sizeof(dxt_block), dxt_block, sizeof(dxt_block));
-        }
+        input += 4;
+        output += 2;
     }
 
     return 0;
 }
 
 
-int calculate_average_color(unsigned char *imgdata, int num_pixels, unsigned char color[4]) {
-    uint32_t total_color[4];
+int img2argb1555(unsigned char *input, unsigned char *output, int num_pixels) {
+    /*
+     * Converts image data to ARGB1555 data. Alpha is thresholded at 50%.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    uint16_t pixel;
     int i;
-    int j;
 
-    memset(total_color, 0, 16);
+    for (i = 0; i < num_pixels; i++) {
+        pixel = ((input[3] >= 128) << 15) |
+            (((input[0] * 31 + 127) / 255) << 10) |
+            (((input[1] * 31 + 127) / 255) << 5) |
+            ((input[2] * 31 + 127) / 255);
+
+        output[0] = pixel & 0xff;
+        output[1] = pixel >> 8;
+
+        input += 4;
+        output += 2;
+    }
+
+    return 0;
+}
+
+
+int img2ai88(unsigned char *input, unsigned char *output, int num_pixels) {
+    /*
+     * Converts image data to AI88 (intensity in the low, alpha in the high
+     * byte) data, using the Rec. 601 luma weights for the intensity.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    int i;
 
     for (i = 0; i < num_pixels; i++) {
-        for (j = 0; j < 4; j++)
-            total_color[j] += (uint32_t)imgdata[i * 4 + j];
+        output[0] = (input[0] * 77 + input[1] * 150 + input[2] * 29 + 128) >> 8;
+        output[1] = input[3];
+
+        input += 4;
+        output += 2;
     }
 
-    for (i = 0; i < 4; i++)
-        color[i] = (unsigned char)(total_color[i ^ 2] / num_pixels);
+    return 0;
+}
+
+
+void downsample_row(unsigned char *input, unsigned char *output, int width, int height, int row) {
+    /*
+     * Box filters two rows of the input image into one row of the output
+     * image, which is half as wide and high (width and height are the
+     * input dimensions). Odd last rows and columns are dropped, dimensions
+     * of 1 are kept.
+     */
+
+    unsigned char *top;
+    unsigned char *bottom;
+    int out_width;
+    int right;
+    int x;
+    int c;
+
+    out_width = MAX(1, width / 2);
+    right = width > 1 ? 4 : 0;
+
+    top = input + row * 2 * width * 4;
+    bottom = height > 1 ? top + width * 4 : top;
+    output += row * out_width * 4;
+
+    for (x = 0; x < out_width; x++) {
+        for (c = 0; c < 4; c++)
+            output[c] = (top[c] + top[right + c] + bottom[c] + bottom[right + c] + 2) >> 2;
+
+        top += 8;
+        bottom += 8;
+        output += 4;
+    }
+}
+
+
+int compress_mip_task(int index, void *data) {
+    /*
+     * Task for processing one mip level: the first num_rows tasks each
+     * convert a row of blocks (DXT) or pixels (everything else), the
+     * remaining ones (if downsampled is set) each produce a row of the next
+     * level. Both only read the current
+     * level, so they can run side by side.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct mip_job *job = (struct mip_job *)data;
+
+    unsigned char *input;
+    unsigned char *output;
+    int width;
+
+    if (index >= job->num_rows) {
+        downsample_row(job->dxt.input, job->downsampled, job->dxt.width, job->dxt.height, index - job->num_rows);
+        return 0;
+    }
+
+    if (IS_DXT(job->paatype))
+        return compress_dxt_row(index, &job->dxt);
+
+    width = job->dxt.width;
+    input = job->dxt.input + index * width * 4;
+    output = job->dxt.output + index * width * 2;
+
+    switch (job->paatype) {
+        case ARGB4444:
+            return img2argb4444(input, output, width);
+        case ARGB1555:
+            return img2argb1555(input, output, width);
+        case AI88:
+            return img2ai88(input, output, width);
+        default:
+            return 1;
+    }
 
     return 0;
 }
 
 
-int calculate_maximum_color(unsigned char *imgdata, int num_pixels, unsigned char color[4]) {
+int calculate_colors(unsigned char *imgdata, int num_pixels, unsigned char average[4], unsigned char maximum[4], unsigned char minimum[4]) {
+    /*
+     * Calculates the average, maximum and minimum of every channel in a
+     * single pass over the RGBA image. The average is returned in BGRA
+     * order, as stored in the AVGC TAGG, maximum and minimum in RGBA.
+     *
+     * Returns 0.
+     */
+
+    uint64_t total[4];
     int i;
     int j;
+#ifdef __SSE2__
+    __m128i zero;
+    __m128i pixels;
+    __m128i sums;
+    __m128i max;
+    __m128i min;
+    uint16_t partial[8];
+    unsigned char lanes[16];
+    int batch;
+#endif
 
-    memset(color, 0, 4);
+    memset(total, 0, sizeof(total));
+    memset(maximum, 0, 4);
+    memset(minimum, 0xff, 4);
+
+    i = 0;
+
+#ifdef __SSE2__
+    zero = _mm_setzero_si128();
+    max = zero;
+    min = _mm_set1_epi8(-1);
+
+    // 4 pixels at a time, summed into 16-bit lanes that are flushed before they can overflow
+    while (i + 4 <= num_pixels) {
+        sums = zero;
+        for (batch = 0; batch < 128 && i + 4 <= num_pixels; batch++, i += 4) {
+            pixels = _mm_loadu_si128((__m128i *)(imgdata + i * 4));
+            max = _mm_max_epu8(max, pixels);
+            min = _mm_min_epu8(min, pixels);
+            sums = _mm_add_epi16(sums, _mm_unpacklo_epi8(pixels, zero));
+            sums = _mm_add_epi16(sums, _mm_unpackhi_epi8(pixels, zero));
+        }
 
-    for (i = 0; i < num_pixels; i++) {
+        _mm_storeu_si128((__m128i *)partial, sums);
+        for (j = 0; j < 8; j++)
+            total[j % 4] += partial[j];
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, max);
+    for (j = 0; j < 16; j++)
+        maximum[j % 4] = MAX(maximum[j % 4], lanes[j]);
+
+    _mm_storeu_si128((__m128i *)lanes, min);
+    for (j = 0; j < 16; j++)
+        minimum[j % 4] = MIN(minimum[j % 4], lanes[j]);
+#endif
+
+    for (; i < num_pixels; i++) {
         for (j = 0; j < 4; j++) {
-            if (imgdata[(i ^ 2) * 4 + j] > color[j])
-                color[j] = imgdata[(i ^ 2) * 4 + j];
+            total[j] += imgdata[i * 4 + j];
+            maximum[j] = MAX(maximum[j], imgdata[i * 4 + j]);
+            minimum[j] = MIN(minimum[j], imgdata[i * 4 + j]);
         }
     }
 
+    for (j = 0; j < 4; j++)
+        average[j] = (unsigned char)(total[j ^ 2] / num_pixels);
+
+    return 0;
+}
+
+
+int nearest_power_of_two(int value) {
+    /* Returns the power of two closest to value, at least 4. */
+
+    int power;
+
+    for (power = 4; power * 2 <= value; power *= 2);
+
+    if (value - power > power * 2 - value)
+        power *= 2;
+
+    return power;
+}
+
+
+int fix_dimensions(unsigned char **imgdata, int *width, int *height, bool scale) {
+    /*
+     * Brings the RGBA image to dimensions that can be stored in a PAA. With
+     * scale set, it is resampled to the nearest power of two in both
+     * directions, otherwise its last column and row are repeated up to
+     * the next multiple of 4. The old image data is freed.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    unsigned char *fixed;
+    int new_width;
+    int new_height;
+    int x;
+    int y;
+
+    if (scale) {
+        new_width = nearest_power_of_two(*width);
+        new_height = nearest_power_of_two(*height);
+    } else {
+        new_width = (*width + 3) / 4 * 4;
+        new_height = (*height + 3) / 4 * 4;
+    }
+
+    if (new_width == *width && new_height == *height)
+        return 0;
+
+    fixed = (unsigned char *)safe_malloc(new_width * new_height * 4);
+
+    if (scale) {
+        if (!stbir_resize_uint8(*imgdata, *width, *height, 0, fixed, new_width, new_height, 0, 4)) {
+            free(fixed);
+            return 1;
+        }
+    } else {
+        for (y = 0; y < new_height; y++) {
+            memcpy(fixed + y * new_width * 4, *imgdata + MIN(y, *height - 1) * *width * 4, *width * 4);
+            for (x = *width; x < new_width; x++)
+                memcpy(fixed + (y * new_width + x) * 4, fixed + (y * new_width + *width - 1) * 4, 4);
+        }
+    }
+
+    stbi_image_free(*imgdata);
+    *imgdata = fixed;
+    *width = new_width;
+    *height = new_height;
+
     return 0;
 }
 
@@ -160,14 +775,24 @@ int img2paa(char *source, char *target) {
     int w;
     int h;
     int i;
-    lzo_uint in_len;
+    int num_tasks;
+    int success;
     lzo_uint out_len;
+    size_t lzss_len;
+    size_t lzo_len;
     bool compressed;
+    bool best;
+    struct mip_job job;
     unsigned char *imgdata;
-    unsigned char *tmp;
+    unsigned char *currentdata;
+    unsigned char *mipdata;
     unsigned char *workmem;
     unsigned char *outputdata;
-    unsigned char color[4];
+    unsigned char *compresseddata;
+    unsigned char *data;
+    unsigned char average[4];
+    unsigned char maximum[4];
+    unsigned char minimum[4];
     
     if (!args.paatype) {
         paatype = 0;
@@ -179,38 +804,51 @@ int img2paa(char *source, char *target) {
     } else if (stricmp("DXT5", args.paatype) == 0) {
         paatype = DXT5;
     } else if (stricmp("ARGB4444", args.paatype) == 0) {
-        errorf("ARGB4444 support is not implemented.\n");
-        return 4;
+        paatype = ARGB4444;
     } else if (stricmp("ARGB1555", args.paatype) == 0) {
-        errorf("ARGB1555 support is not implemented.\n");
-        return 4;
+        paatype = ARGB1555;
     } else if (stricmp("AI88", args.paatype) == 0) {
-        errorf("AI88 support is not implemented.\n");
-        return 4;
+        paatype = AI88;
     } else {
         errorf("Unrecognized PAA type \"%s\".\n", args.paatype);
         return 4;
     }
 
+    if (args.quality && stricmp("fast", args.quality) != 0 && stricmp("high", args.quality) != 0) {
+        errorf("Unrecognized quality \"%s\".\n", args.quality);
+        return 4;
+    }
+
+    if (args.level && stricmp("fast", args.level) != 0 && stricmp("best", args.level) != 0) {
+        errorf("Unrecognized compression level \"%s\".\n", args.level);
+        return 4;
+    }
+    best = args.level != NULL && stricmp("best", args.level) == 0;
+
+    if (args.resize && stricmp("pad", args.resize) != 0 && stricmp("scale", args.resize) != 0) {
+        errorf("Unrecognized resize mode \"%s\".\n", args.resize);
+        return 4;
+    }
+
     imgdata = stbi_load(source, &w, &h, &num_channels, 4);
     if (!imgdata) {
         errorf("Failed to load image.\n");
         return 1;
     }
 
+    if (args.resize && fix_dimensions(&imgdata, &w, &h, stricmp("scale", args.resize) == 0)) {
+        errorf("Failed to resize image.\n");
+        stbi_image_free(imgdata);
+        return 2;
+    }
+
     width = w;
     height = h;
 
-    // Check if alpha channel is necessary
-    if (num_channels == 4) {
+    // Average and maximum color for the TAGGs, the minimum alpha tells us if the alpha channel is necessary
+    calculate_colors(imgdata, width * height, average, maximum, minimum);
+    if (num_channels == 4 && minimum[3] == 0xff)
         num_channels--;
-        for (i = 3; i < width * height * 4; i += 4) {
-            if (imgdata[i] < 0xff) {
-                num_channels++;
-                break;
-            }
-        }
-    }
 
     // Unless told otherwise, use DXT5 for alpha stuff and DXT1 for everything else
     if (paatype == 0) {
@@ -218,20 +856,15 @@ int img2paa(char *source, char *target) {
     }
 
     if (width % 4 != 0 || height % 4 != 0) {
-        errorf("Dimensions are no multiple of 4.\n");
+        errorf("Dimensions are no multiple of 4, use --resize to fix them.\n");
         stbi_image_free(imgdata);
         return 2;
     }
 
-    tmp = (unsigned char *)safe_malloc(width * height * 4);
-    memcpy(tmp, imgdata, width * height * 4);
-    stbi_image_free(imgdata);
-    imgdata = tmp;
-
     f_target = fopen(target, "wb");
     if (!f_target) {
         errorf("Failed to open target file.\n");
-        free(imgdata);
+        stbi_image_free(imgdata);
         return 3;
     }
 
@@ -241,13 +874,11 @@ int img2paa(char *source, char *target) {
     // TAGGs
     fwrite("GGATCGVA", 8, 1, f_target);
     fwrite("\x04\x00\x00\x00", 4, 1, f_target);
-    calculate_average_color(imgdata, width * height, color);
-    fwrite(color, sizeof(color), 1, f_target);
+    fwrite(average, sizeof(average), 1, f_target);
 
     fwrite("GGATCXAM", 8, 1, f_target);
     fwrite("\x04\x00\x00\x00", 4, 1, f_target);
-    calculate_maximum_color(imgdata, width * height, color);
-    fwrite(color, sizeof(color), 1, f_target);
+    fwrite(maximum, sizeof(maximum), 1, f_target);
 
     fwrite("GGATSFFO", 8, 1, f_target);
     fwrite("\x40\x00\x00\x00", 4, 1, f_target);
@@ -258,68 +889,92 @@ int img2paa(char *source, char *target) {
     // Palette
     fwrite("\x00\x00", 2, 1, f_target);
 
+    /*
+     * All buffers are allocated up front and reused for every level: the
+     * source image and mipdata take turns holding the current level and
+     * the next one, and the output and compression buffers are sized for
+     * the first (largest) level.
+     */
+    datalen = mipmap_length(paatype, width, height);
+
+    outputdata = (unsigned char *)safe_malloc(datalen);
+    mipdata = (unsigned char *)safe_malloc(width * height);
+    compresseddata = NULL;
+    workmem = NULL;
+
+    if (!IS_DXT(paatype)) {
+        compresseddata = (unsigned char *)safe_malloc(LZSS_BOUND(datalen));
+    } else if (args.compress) {
+        compresseddata = (unsigned char *)safe_malloc(LZO_BOUND(datalen));
+        workmem = (unsigned char *)safe_malloc(best ? LZO_BEST_MEM_COMPRESS : LZO1X_MEM_COMPRESS);
+
+        if (lzo_init() != LZO_E_OK) {
+            errorf("Failed to initialize LZO for compression.\n");
+            success = 6;
+            goto cleanup;
+        }
+    }
+
+    currentdata = imgdata;
+
     // MipMaps
     for (i = 0; i < 15; i++) {
-        datalen = width * height;
-        if (paatype == DXT1)
-            datalen /= 2;
-
-        outputdata = (unsigned char *)safe_malloc(datalen);
-
-        // Convert to output format
-        switch (paatype) {
-            case DXT1:
-                if (img2dxt1(imgdata, outputdata, width, height)) {
-                    errorf("Failed to convert image data to DXT1.\n");
-                    free(outputdata);
-                    free(imgdata);
-                    return 5;
-                }
-                break;
-            case DXT5:
-                if (img2dxt5(imgdata, outputdata, width, height)) {
-                    errorf("Failed to convert image data to DXT5.\n");
-                    free(outputdata);
-                    free(imgdata);
-                    return 5;
-                }
-                break;
-            default:
-                free(outputdata);
-                free(imgdata);
-                return 5;
+        datalen = mipmap_length(paatype, width, height);
+
+        // Convert to output format, while already downsampling the next level
+        init_dxt_job(&job.dxt, currentdata, outputdata, width, height, paatype == DXT5);
+        job.paatype = paatype;
+        job.num_rows = IS_DXT(paatype) ? (height + 3) / 4 : height;
+        if (i < 14 && (width > 1 || height > 1)) {
+            job.downsampled = (currentdata == imgdata) ? mipdata : imgdata;
+            num_tasks = job.num_rows + MAX(1, height / 2);
+        } else {
+            job.downsampled = NULL;
+            num_tasks = job.num_rows;
+        }
+
+        if (parallel_for(num_tasks, compress_mip_task, &job)) {
+            errorf("Failed to convert image data.\n");
+            success = 5;
+            goto cleanup;
+        }
+
+        data = outputdata;
+
+        // LZSS compression for the non-DXT formats, unless it doesn't help
+        if (!IS_DXT(paatype)) {
+            if (lzss_compress(outputdata, datalen, compresseddata, &lzss_len, true)) {
+                errorf("Failed to compress image data.\n");
+                success = 6;
+                goto cleanup;
+            }
+
+            if (lzss_len < datalen) {
+                data = compresseddata;
+                datalen = lzss_len;
+            }
         }
 
         // LZO compression
-        compressed = args.compress && datalen > LZO1X_MEM_COMPRESS;
-
-        if (compressed) {
-            tmp = (unsigned char *)safe_malloc(datalen);
-            workmem = (unsigned char *)safe_malloc(LZO1X_MEM_COMPRESS);
-            in_len = datalen;
-
-            memcpy(tmp, outputdata, datalen);
-
-            if (lzo_init() != LZO_E_OK) {
-                errorf("Failed to initialize LZO for compression.\n");
-                free(workmem);
-                free(tmp);
-                free(outputdata);
-                free(imgdata);
-                return 6;
-	    }
-            if (lzo1x_1_compress(tmp, in_len, outputdata, &out_len, workmem) != LZO_E_OK) {
+        compressed = IS_DXT(paatype) && args.compress && datalen > LZO1X_MEM_COMPRESS;
+
+        if (compressed && best) {
+            if (lzo_compress_best(outputdata, datalen, compresseddata, &lzo_len, workmem)) {
                 errorf("Failed to compress image data.\n");
-                free(workmem);
-                free(tmp);
-                free(outputdata);
-                free(imgdata);
-                return 6;
+                success = 6;
+                goto cleanup;
             }
 
-            free(workmem);
-            free(tmp);
+            data = compresseddata;
+            datalen = lzo_len;
+        } else if (compressed) {
+            if (lzo1x_1_compress(outputdata, datalen, compresseddata, &out_len, workmem) != LZO_E_OK) {
+                errorf("Failed to compress image data.\n");
+                success = 6;
+                goto cleanup;
+            }
 
+            data = compresseddata;
             datalen = out_len;
         }
 
@@ -332,25 +987,24 @@ int img2paa(char *source, char *target) {
             width -= 32768;
         fwrite(&height, sizeof(height), 1, f_target);
         fwrite(&datalen, 3, 1, f_target);
-        fwrite(outputdata, datalen, 1, f_target);
-
-        free(outputdata);
-
-        // Resize image for next MipMap
-        width /= 2;
-        height /= 2;
-
-        if (width < 4 || height < 4) { break; }
-
-        tmp = (unsigned char *)safe_malloc(width * height * 4);
-        if (!stbir_resize_uint8(imgdata, width * 2, height * 2, 0, tmp, width, height, 0, 4)) {
-            errorf("Failed to resize image.\n");
-            free(tmp);
-            free(imgdata);
-            return 7;
+        fwrite(data, datalen, 1, f_target);
+
+        // Continue with the next MipMap, down to 1x1
+        width = MAX(1, width / 2);
+        height = MAX(1, height / 2);
+
+        /*
+         * This was the last MipMap. Count it before leaving the loop, so the
+         * terminator gets its own offset entry after it, just like when the
+         * loop runs through all 15 levels, instead of overwriting the offset
+         * of the smallest MipMap.
+         */
+        if (job.downsampled == NULL) {
+            i++;
+            break;
         }
-        free(imgdata);
-        imgdata = tmp;
+
+        currentdata = job.downsampled;
     }
 
     offsets[i] = ftell(f_target);
@@ -362,19 +1016,32 @@ int img2paa(char *source, char *target) {
     fseek(f_target, fp_offsets, SEEK_SET);
     fwrite(offsets, sizeof(offsets), 1, f_target);
 
+    success = 0;
+
+cleanup:
     fclose(f_target);
-    free(imgdata);
-    
-    return 0;
+    stbi_image_free(imgdata);
+    free(mipdata);
+    free(outputdata);
+    free(compresseddata);
+    free(workmem);
+
+    return success;
 }
 
 
 int cmd_img2paa() {
     extern struct arguments args;
+    char *extensions[] = { "png", "tga", "jpg", "jpeg", "bmp", "psd", "gif", NULL };
 
     if (args.num_positionals != 3)
         return 128;
 
+    if (args.batch) {
+        prepare_dxt();
+        return convert_directory(args.positionals[1], args.positionals[2], extensions, "paa", args.force, img2paa);
+    }
+
     // check if target already exists
     if (access(args.positionals[2], F_OK) != -1 && !args.force) {
         errorf("File %s already exists and --force was not set.\n", args.positionals[2]);
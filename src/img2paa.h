@@ -19,10 +19,64 @@
 #pragma once
 
 
+#include <stdbool.h>
+#include <stdint.h>
+
+
+struct dxt_job {
+    unsigned char *input;
+    unsigned char *output;
+    int width;
+    int height;
+    int alpha;
+    int block_size;
+    bool fast;
+};
+
+struct mip_job {
+    struct dxt_job dxt;
+    uint16_t paatype;
+    int num_rows;
+    unsigned char *downsampled;
+};
+
+
+void dxt_bounding_box(unsigned char *block, unsigned char min[4], unsigned char max[4]);
+
+uint32_t dxt_color_indices(unsigned char *block, unsigned char colors[4][4]);
+
+void dxt_alpha_indices(unsigned char *block, int thresholds[7], unsigned char indices[16]);
+
+void compress_dxt_block_fast(unsigned char *dest, unsigned char *block, int alpha);
+
+int compress_dxt_row(int row, void *data);
+
+void prepare_dxt();
+
+void init_dxt_job(struct dxt_job *job, unsigned char *input, unsigned char *output, int width, int height, int alpha);
+
+int img2dxt(unsigned char *input, unsigned char *output, int width, int height, int alpha);
+
 int img2dxt1(unsigned char *input, unsigned char *output, int width, int height);
 
 int img2dxt5(unsigned char *input, unsigned char *output, int width, int height);
 
+int img2argb4444(unsigned char *input, unsigned char *output, int num_pixels);
+
+int img2argb1555(unsigned char *input, unsigned char *output, int num_pixels);
+
+int img2ai88(unsigned char *input, unsigned char *output, int num_pixels);
+
+int calculate_colors(unsigned char *imgdata, int num_pixels, unsigned char average[4], unsigned char maximum[4], unsigned char minimum[4]);
+
+void downsample_row(unsigned char *input, unsigned char *output, int width, int height, int row);
+
+int compress_mip_task(int index, void *data);
+
+int nearest_power_of_two(int value);
+
+int fix_dimensions(unsigned char **imgdata, int *width, int *height, bool scale);
+
 int img2paa(char *source, char *target);
 
 int cmd_img2paa();
@@ -29,6 +29,7 @@
 #include "args.h"
 #include "filesystem.h"
 #include "utils.h"
+#include "threads.h"
 #include "keygen.h"
 
 
@@ -82,33 +83,14 @@ int custom_bn2lebinpad(const BIGNUM *a, unsigned char *to, int tolen) {
 }
 
 
-int generate_keypair(char *name, char *path_private, char *path_public) {
+void seed_prng() {
     /*
-     * Generates a BI key pair (.bikey and .biprivatekey) for the given paths
-     * with the given name. Existing files are overwritten. Returns 0 on
-     * success and a positive integer on failure.
+     * Seeds OpenSSL's PRNG once per process. With OpenSSL 1.1 and later the
+     * per-thread generators used by the key generation are seeded from this
+     * one, so generating several keys doesn't wait on the system's entropy
+     * pool more than once.
      */
 
-    RSA *rsa;
-    BIGNUM *exponent;
-    const BIGNUM *n, *p, *q, *dmp1, *dmq1, *iqmp, *d;
-    uint32_t exponent_le;
-    uint32_t exponent_be;
-    uint32_t length;
-    uint32_t temp;
-    unsigned char buffer[4096];
-    FILE *f_private;
-    FILE *f_public;
-
-    length = KEY_LENGTH;
-
-    // convert exponent to bignum
-    exponent_le = KEY_EXPONENT;
-    exponent_be = exponent_le;
-    reverse_endianness(&exponent_be, sizeof(exponent_be));
-    exponent = BN_bin2bn((unsigned char *)&exponent_be, sizeof(exponent_be), NULL);
-
-    // seed PRNG
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
     do {
         RAND_poll();
@@ -130,6 +112,35 @@ int generate_keypair(char *name, char *path_private, char *path_public) {
     fclose(f_random);
 #endif
 #endif
+}
+
+
+int generate_keypair(char *name, char *path_private, char *path_public) {
+    /*
+     * Generates a BI key pair (.bikey and .biprivatekey) for the given paths
+     * with the given name. Existing files are overwritten. The PRNG has to
+     * be seeded with seed_prng first. Returns 0 on success and a positive
+     * integer on failure.
+     */
+
+    RSA *rsa;
+    BIGNUM *exponent;
+    const BIGNUM *n, *p, *q, *dmp1, *dmq1, *iqmp, *d;
+    uint32_t exponent_le;
+    uint32_t exponent_be;
+    uint32_t length;
+    uint32_t temp;
+    unsigned char buffer[4096];
+    FILE *f_private;
+    FILE *f_public;
+
+    length = KEY_LENGTH;
+
+    // convert exponent to bignum
+    exponent_le = KEY_EXPONENT;
+    exponent_be = exponent_le;
+    reverse_endianness(&exponent_be, sizeof(exponent_be));
+    exponent = BN_bin2bn((unsigned char *)&exponent_be, sizeof(exponent_be), NULL);
 
     // generate keypair
     rsa = RSA_new();
@@ -198,54 +209,102 @@ int generate_keypair(char *name, char *path_private, char *path_public) {
     BN_free(exponent);
     RSA_free(rsa);
 
-    CRYPTO_cleanup_all_ex_data();
-
     return 0;
 }
 
 
+void keypair_paths(char *path, char *name, char *path_private, char *path_public) {
+    /*
+     * Derives the key name and the paths of both key files from the path
+     * passed to keygen. The buffers have to hold 512 bytes for the name and
+     * 2048 bytes for each path.
+     */
+
+    if (strrchr(path, PATHSEP) == NULL)
+        strncpy(name, path, 511);
+    else
+        strncpy(name, strrchr(path, PATHSEP) + 1, 511);
+    name[511] = 0;
+
+    strcpy(path_private, path);
+    strcat(path_private, ".biprivatekey");
+
+    strcpy(path_public, path);
+    strcat(path_public, ".bikey");
+}
+
+
+int keygen_task(int index, void *data) {
+    char **paths = (char **)data;
+    char name[512];
+    char path_private[2048];
+    char path_public[2048];
+    int success;
+
+    keypair_paths(paths[index], name, path_private, path_public);
+
+    success = generate_keypair(name, path_private, path_public);
+    if (success)
+        errorf("Failed to generate key pair %s.\n", name);
+
+    return success;
+}
+
+
 int cmd_keygen() {
+    /*
+     * Generates a key pair for every given path. The PRNG is seeded once
+     * and the keys are generated in parallel.
+     */
+
     extern struct arguments args;
     char name[512];
     char path_private[2048];
     char path_public[2048];
     int success;
+    int i;
 
-    if (args.num_positionals != 2)
+    if (args.num_positionals < 2)
         return 128;
 
+    for (i = 1; i < args.num_positionals; i++) {
 #ifdef _WIN32
-    int i;
-    for (i = 0; i < strlen(args.positionals[1]); i++)
-        if (args.positionals[1][i] == '/')
-            args.positionals[1][i] = PATHSEP;
+        int j;
+        for (j = 0; j < strlen(args.positionals[i]); j++)
+            if (args.positionals[i][j] == '/')
+                args.positionals[i][j] = PATHSEP;
 #endif
 
-    if (strrchr(args.positionals[1], PATHSEP) == NULL)
-        strcpy(name, args.positionals[1]);
-    else
-        strcpy(name, strrchr(args.positionals[1], PATHSEP) + 1);
-
-    strcpy(path_private, args.positionals[1]);
-    strcat(path_private, ".biprivatekey");
-
-    strcpy(path_public, args.positionals[1]);
-    strcat(path_public, ".bikey");
-
-    // check if target already exists
-    if (access(path_private, F_OK) != -1 && !args.force) {
-        errorf("File %s already exists and --force was not set.\n", path_private);
-        return 1;
-    }
-    if (access(path_public, F_OK) != -1 && !args.force) {
-        errorf("File %s already exists and --force was not set.\n", path_public);
-        return 1;
+        if (strlen(args.positionals[i]) + strlen(".biprivatekey") >= sizeof(path_private)) {
+            errorf("Path %s is too long.\n", args.positionals[i]);
+            return 1;
+        }
+
+        keypair_paths(args.positionals[i], name, path_private, path_public);
+
+        // check if target already exists
+        if (access(path_private, F_OK) != -1 && !args.force) {
+            errorf("File %s already exists and --force was not set.\n", path_private);
+            return 1;
+        }
+        if (access(path_public, F_OK) != -1 && !args.force) {
+            errorf("File %s already exists and --force was not set.\n", path_public);
+            return 1;
+        }
     }
 
-    success = generate_keypair(name, path_private, path_public);
+    seed_prng();
 
-    if (success)
-        errorf("Failed to generate key pair.\n");
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    success = parallel_for(args.num_positionals - 1, keygen_task, args.positionals + 1);
+#else
+    // OpenSSL before 1.1 isn't thread-safe without locking callbacks
+    success = 0;
+    for (i = 0; i < args.num_positionals - 1 && !success; i++)
+        success = keygen_task(i, args.positionals + 1);
+#endif
+
+    CRYPTO_cleanup_all_ex_data();
 
     return success;
 }
@@ -26,8 +26,14 @@
 #include <openssl/bn.h>
 
 
+void seed_prng();
+
 int generate_keypair(char *name, char *path_private, char *path_public);
 
 int custom_bn2lebinpad(const BIGNUM *a, unsigned char *to, int tolen);
 
+void keypair_paths(char *path, char *name, char *path_private, char *path_public);
+
+int keygen_task(int index, void *data);
+
 int cmd_keygen();
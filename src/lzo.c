@@ -0,0 +1,261 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "lzo.h"
+
+
+/*
+ * An LZO1X compressor trading speed for ratio, for when minilzo's
+ * lzo1x_1_compress isn't good enough. It writes the same format, so the
+ * output is read by the regular lzo1x_decompress. Matches are searched
+ * through long hash chains over the whole LZO1X window, and taken lazily:
+ * if the next position has a longer match, a literal is emitted instead.
+ *
+ * Match encodings used, by offset and length:
+ *   M2: offset <= 0x800, length 3-8, 2 bytes
+ *   M3: offset <= 0x4000, 3 bytes plus length extension
+ *   M4: offset <= 0xbfff, 3 bytes plus length extension
+ * Up to 3 literals following a match are stored in the low bits of its
+ * second to last byte.
+ */
+
+
+#define LZO_M2_MAX_OFFSET 0x0800
+#define LZO_M3_MAX_OFFSET 0x4000
+#define LZO_M2_MAX_LEN 8
+#define LZO_M3_MAX_LEN 33
+#define LZO_M4_MAX_LEN 9
+#define LZO_M3_MARKER 32
+#define LZO_M4_MARKER 16
+
+#define LZO_HASH(p) (((((uint32_t)(p)[0] << 16) | ((p)[1] << 8) | (p)[2]) * 2654435761u) >> 16)
+
+
+size_t lzo_best_match(unsigned char *input, size_t in_len, size_t pos, int32_t *head, int32_t *prev, size_t *offset) {
+    /*
+     * Finds the longest match for the data at pos. Matches that wouldn't
+     * be shorter than the literals they replace (length 3 beyond M2 reach)
+     * are ignored.
+     *
+     * Returns the match length, 0 if there is none.
+     */
+
+    int32_t candidate;
+    size_t max_len;
+    size_t len;
+    size_t best_len;
+    int chain;
+
+    if (pos + 3 > in_len)
+        return 0;
+
+    max_len = in_len - pos;
+    best_len = 0;
+    candidate = head[LZO_HASH(input + pos)];
+
+    for (chain = 0; candidate >= 0 && pos - candidate <= LZO_BEST_WINDOW && chain < LZO_BEST_MAX_CHAIN; chain++) {
+        if (input[candidate + best_len] == input[pos + best_len]) {
+            for (len = 0; len < max_len && input[candidate + len] == input[pos + len]; len++);
+
+            if (len > best_len && (len > 3 || pos - candidate <= LZO_M2_MAX_OFFSET)) {
+                best_len = len;
+                *offset = pos - candidate;
+                if (len >= LZO_BEST_NICE_MATCH || len == max_len)
+                    break;
+            }
+        }
+
+        candidate = prev[candidate & 0xffff];
+    }
+
+    return best_len >= 3 ? best_len : 0;
+}
+
+
+unsigned char *lzo_write_literals(unsigned char *op, unsigned char *output, unsigned char *literals, size_t num_literals) {
+    /*
+     * Writes a run of literals. Only a stream's first run may start with
+     * a count above 17, short runs after a match go into the match itself.
+     *
+     * Returns the new output position.
+     */
+
+    size_t t;
+
+    if (num_literals == 0)
+        return op;
+
+    if (op == output && num_literals <= 238) {
+        *op++ = 17 + num_literals;
+    } else if (num_literals <= 3) {
+        op[-2] |= num_literals;
+    } else if (num_literals <= 18) {
+        *op++ = num_literals - 3;
+    } else {
+        t = num_literals - 18;
+        *op++ = 0;
+        for (; t > 255; t -= 255)
+            *op++ = 0;
+        *op++ = t;
+    }
+
+    memcpy(op, literals, num_literals);
+    return op + num_literals;
+}
+
+
+unsigned char *lzo_write_match(unsigned char *op, size_t len, size_t offset) {
+    /*
+     * Writes a match, picking the shortest encoding for it.
+     *
+     * Returns the new output position.
+     */
+
+    size_t t;
+
+    if (len <= LZO_M2_MAX_LEN && offset <= LZO_M2_MAX_OFFSET) {
+        offset -= 1;
+        *op++ = ((len - 1) << 5) | ((offset & 7) << 2);
+        *op++ = offset >> 3;
+        return op;
+    }
+
+    if (offset <= LZO_M3_MAX_OFFSET) {
+        offset -= 1;
+        if (len <= LZO_M3_MAX_LEN) {
+            *op++ = LZO_M3_MARKER | (len - 2);
+        } else {
+            *op++ = LZO_M3_MARKER;
+            for (t = len - LZO_M3_MAX_LEN; t > 255; t -= 255)
+                *op++ = 0;
+            *op++ = t;
+        }
+    } else {
+        offset -= 0x4000;
+        if (len <= LZO_M4_MAX_LEN) {
+            *op++ = LZO_M4_MARKER | ((offset >> 11) & 8) | (len - 2);
+        } else {
+            *op++ = LZO_M4_MARKER | ((offset >> 11) & 8);
+            for (t = len - LZO_M4_MAX_LEN; t > 255; t -= 255)
+                *op++ = 0;
+            *op++ = t;
+        }
+    }
+
+    *op++ = (offset << 2) & 0xff;
+    *op++ = (offset >> 6) & 0xff;
+    return op;
+}
+
+
+int lzo_compress_best(unsigned char *input, size_t in_len, unsigned char *output, size_t *out_len, void *workmem) {
+    /*
+     * Compresses in_len bytes of input into output, which has to be able to
+     * hold LZO_BOUND(in_len) bytes. workmem has to be LZO_BEST_MEM_COMPRESS
+     * bytes large.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    int32_t *head;
+    int32_t *prev;
+    unsigned char *op;
+    size_t literals;
+    size_t pos;
+    size_t len;
+    size_t next_len;
+    size_t offset;
+    size_t next_offset;
+    size_t end;
+    int i;
+
+    head = (int32_t *)workmem;
+    prev = head + LZO_BEST_HASH_SIZE;
+
+    for (i = 0; i < LZO_BEST_HASH_SIZE; i++)
+        head[i] = -1;
+
+    op = output;
+    literals = 0;
+    pos = 0;
+    len = 0;
+
+    while (pos < in_len) {
+        if (len == 0)
+            len = lzo_best_match(input, in_len, pos, head, prev, &offset);
+
+        if (len > 0) {
+            if (pos + 3 <= in_len) {
+                prev[pos & 0xffff] = head[LZO_HASH(input + pos)];
+                head[LZO_HASH(input + pos)] = pos;
+            }
+
+            // lazy matching: a longer match one byte later is worth a literal
+            next_len = len < LZO_BEST_NICE_MATCH ? lzo_best_match(input, in_len, pos + 1, head, prev, &next_offset) : 0;
+            if (next_len > len) {
+                pos++;
+                literals++;
+                len = next_len;
+                offset = next_offset;
+                continue;
+            }
+
+            op = lzo_write_literals(op, output, input + pos - literals, literals);
+            op = lzo_write_match(op, len, offset);
+            literals = 0;
+
+            for (end = pos + len, pos++; pos < end; pos++) {
+                if (pos + 3 > in_len)
+                    continue;
+                prev[pos & 0xffff] = head[LZO_HASH(input + pos)];
+                head[LZO_HASH(input + pos)] = pos;
+            }
+
+            len = 0;
+            continue;
+        }
+
+        if (pos + 3 <= in_len) {
+            prev[pos & 0xffff] = head[LZO_HASH(input + pos)];
+            head[LZO_HASH(input + pos)] = pos;
+        }
+
+        pos++;
+        literals++;
+        len = 0;
+    }
+
+    op = lzo_write_literals(op, output, input + pos - literals, literals);
+
+    // end of stream marker
+    *op++ = LZO_M4_MARKER | 1;
+    *op++ = 0;
+    *op++ = 0;
+
+    *out_len = op - output;
+
+    return 0;
+}
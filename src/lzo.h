@@ -0,0 +1,44 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#pragma once
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LZO_BEST_WINDOW 0xbfff
+#define LZO_BEST_HASH_SIZE 65536
+#define LZO_BEST_MAX_CHAIN 512
+#define LZO_BEST_NICE_MATCH 256
+
+#define LZO_BEST_MEM_COMPRESS (sizeof(int32_t) * (LZO_BEST_HASH_SIZE + 65536))
+
+// same worst case as lzo1x_1, see the LZO FAQ
+#define LZO_BOUND(len) ((len) + (len) / 16 + 64 + 3)
+
+
+size_t lzo_best_match(unsigned char *input, size_t in_len, size_t pos, int32_t *head, int32_t *prev, size_t *offset);
+
+unsigned char *lzo_write_literals(unsigned char *op, unsigned char *output, unsigned char *literals, size_t num_literals);
+
+unsigned char *lzo_write_match(unsigned char *op, size_t len, size_t offset);
+
+int lzo_compress_best(unsigned char *input, size_t in_len, unsigned char *output, size_t *out_len, void *workmem);
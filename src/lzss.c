@@ -0,0 +1,310 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "lzss.h"
+
+
+/*
+ * BI's LZSS variant: every flag byte is followed by up to eight items, bit
+ * n (LSB first) set means item n is a literal byte, unset means it's a
+ * two-byte back reference: 12 bits of distance (low byte, then the high
+ * nibble of the second byte) and 4 bits of length - 3. References before
+ * the start of the data produce spaces. The compressed data is followed by
+ * a 32-bit sum of all uncompressed bytes, which PAAs compute over signed
+ * and PBOs over unsigned bytes.
+ */
+
+
+uint32_t lzss_checksum(unsigned char *data, size_t len, bool signed_checksum) {
+    uint32_t checksum = 0;
+    size_t i;
+
+    if (signed_checksum) {
+        for (i = 0; i < len; i++)
+            checksum += (uint32_t)(int32_t)(signed char)data[i];
+    } else {
+        for (i = 0; i < len; i++)
+            checksum += data[i];
+    }
+
+    return checksum;
+}
+
+
+int lzss_compress(unsigned char *input, size_t in_len, unsigned char *output, size_t *out_len, bool signed_checksum) {
+    /*
+     * Compresses in_len bytes of input into output, which has to be able to
+     * hold LZSS_BOUND(in_len) bytes. Matches are found greedily through
+     * hash chains over the last LZSS_WINDOW positions.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    int32_t *head;
+    int32_t *prev;
+    int32_t candidate;
+    uint32_t checksum;
+    size_t pos;
+    size_t out;
+    size_t flag_pos;
+    size_t max_len;
+    size_t len;
+    size_t best_len;
+    size_t best_distance;
+    size_t advance;
+    int chain;
+    int bit;
+    int i;
+
+    head = (int32_t *)safe_malloc(sizeof(int32_t) * LZSS_HASH_SIZE);
+    prev = (int32_t *)safe_malloc(sizeof(int32_t) * LZSS_WINDOW);
+
+    for (i = 0; i < LZSS_HASH_SIZE; i++)
+        head[i] = -1;
+
+#define LZSS_HASH(p) ((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & (LZSS_HASH_SIZE - 1))
+
+    pos = 0;
+    out = 0;
+
+    while (pos < in_len) {
+        flag_pos = out++;
+        output[flag_pos] = 0;
+
+        for (bit = 0; bit < 8 && pos < in_len; bit++) {
+            best_len = 0;
+            best_distance = 0;
+
+            if (pos + LZSS_MIN_MATCH <= in_len) {
+                max_len = MIN(LZSS_MAX_MATCH, in_len - pos);
+                candidate = head[LZSS_HASH(input + pos)];
+
+                for (chain = 0; candidate >= 0 && pos - candidate < LZSS_WINDOW && chain < LZSS_MAX_CHAIN; chain++) {
+                    for (len = 0; len < max_len && input[candidate + len] == input[pos + len]; len++);
+
+                    if (len > best_len) {
+                        best_len = len;
+                        best_distance = pos - candidate;
+                        if (len == max_len)
+                            break;
+                    }
+
+                    candidate = prev[candidate % LZSS_WINDOW];
+                }
+            }
+
+            if (best_len >= LZSS_MIN_MATCH) {
+                output[out++] = best_distance & 0xff;
+                output[out++] = ((best_distance >> 4) & 0xf0) | (best_len - LZSS_MIN_MATCH);
+                advance = best_len;
+            } else {
+                output[flag_pos] |= 1 << bit;
+                output[out++] = input[pos];
+                advance = 1;
+            }
+
+            for (; advance > 0; advance--, pos++) {
+                if (pos + LZSS_MIN_MATCH > in_len)
+                    continue;
+                prev[pos % LZSS_WINDOW] = head[LZSS_HASH(input + pos)];
+                head[LZSS_HASH(input + pos)] = pos;
+            }
+        }
+    }
+
+#undef LZSS_HASH
+
+    checksum = lzss_checksum(input, in_len, signed_checksum);
+    for (i = 0; i < 4; i++)
+        output[out++] = (checksum >> (8 * i)) & 0xff;
+
+    *out_len = out;
+
+    free(head);
+    free(prev);
+
+    return 0;
+}
+
+
+int lzss_decompress(unsigned char *input, size_t in_len, unsigned char *output, size_t out_len, bool signed_checksum) {
+    /*
+     * Decompresses input into exactly out_len bytes of output and verifies
+     * the checksum following the compressed data.
+     *
+     * Returns 0 on success, 1 if the input ended early and 2 if the
+     * checksum doesn't match.
+     */
+
+    uint32_t checksum;
+    size_t in;
+    size_t pos;
+    size_t distance;
+    size_t len;
+    unsigned char flags;
+    int bit;
+    int i;
+
+    in = 0;
+    pos = 0;
+
+    while (pos < out_len) {
+        if (in >= in_len)
+            return 1;
+        flags = input[in++];
+
+        for (bit = 0; bit < 8 && pos < out_len; bit++, flags >>= 1) {
+            if (flags & 1) {
+                if (in >= in_len)
+                    return 1;
+                output[pos++] = input[in++];
+                continue;
+            }
+
+            if (in + 2 > in_len)
+                return 1;
+            distance = input[in] | ((input[in + 1] & 0xf0) << 4);
+            len = (input[in + 1] & 0x0f) + LZSS_MIN_MATCH;
+            in += 2;
+
+            len = MIN(len, out_len - pos);
+
+            for (; len > 0 && pos < distance; len--)
+                output[pos++] = ' ';
+
+            // byte by byte, since the reference may overlap the output
+            for (; len > 0; len--, pos++)
+                output[pos] = output[pos - distance];
+        }
+    }
+
+    if (in + 4 > in_len)
+        return 1;
+
+    checksum = 0;
+    for (i = 0; i < 4; i++)
+        checksum |= (uint32_t)input[in + i] << (8 * i);
+
+    if (checksum != lzss_checksum(output, out_len, signed_checksum))
+        return 2;
+
+    return 0;
+}
+
+
+int lzss_decompress_file(unsigned char *input, size_t in_len, size_t out_len, FILE *f, bool signed_checksum) {
+    /*
+     * Decompresses input into out_len bytes written to f, verifying the
+     * checksum. Only the window the back references can reach is kept in
+     * memory, so large entries are decoded without staging the whole
+     * output.
+     *
+     * Returns 0 on success, 1 if the input ended early, 2 if the checksum
+     * doesn't match and 3 if writing fails.
+     */
+
+    unsigned char *buffer;
+    uint32_t checksum;
+    uint32_t expected;
+    size_t in;
+    size_t pos;
+    size_t base;
+    size_t distance;
+    size_t len;
+    unsigned char flags;
+    int success;
+    int bit;
+    int i;
+
+    buffer = (unsigned char *)safe_malloc(LZSS_WINDOW + LZSS_STREAM_BUFFER);
+
+    in = 0;
+    pos = 0; // position in the buffer
+    base = 0; // number of bytes written before the buffer
+    checksum = 0;
+    success = 1;
+
+    while (base + pos < out_len) {
+        if (in >= in_len)
+            goto cleanup;
+        flags = input[in++];
+
+        for (bit = 0; bit < 8 && base + pos < out_len; bit++, flags >>= 1) {
+            // flush all but the window once the next item might not fit
+            if (pos + LZSS_MAX_MATCH > LZSS_WINDOW + LZSS_STREAM_BUFFER) {
+                checksum += lzss_checksum(buffer, pos - LZSS_WINDOW, signed_checksum);
+                if (fwrite(buffer, pos - LZSS_WINDOW, 1, f) != 1) {
+                    success = 3;
+                    goto cleanup;
+                }
+                memmove(buffer, buffer + pos - LZSS_WINDOW, LZSS_WINDOW);
+                base += pos - LZSS_WINDOW;
+                pos = LZSS_WINDOW;
+            }
+
+            if (flags & 1) {
+                if (in >= in_len)
+                    goto cleanup;
+                buffer[pos++] = input[in++];
+                continue;
+            }
+
+            if (in + 2 > in_len)
+                goto cleanup;
+            distance = input[in] | ((input[in + 1] & 0xf0) << 4);
+            len = (input[in + 1] & 0x0f) + LZSS_MIN_MATCH;
+            in += 2;
+
+            len = MIN(len, out_len - base - pos);
+
+            for (; len > 0 && base + pos < distance; len--)
+                buffer[pos++] = ' ';
+
+            // byte by byte, since the reference may overlap the output
+            for (; len > 0; len--, pos++)
+                buffer[pos] = buffer[pos - distance];
+        }
+    }
+
+    checksum += lzss_checksum(buffer, pos, signed_checksum);
+    if (pos > 0 && fwrite(buffer, pos, 1, f) != 1) {
+        success = 3;
+        goto cleanup;
+    }
+
+    if (in + 4 > in_len)
+        goto cleanup;
+
+    expected = 0;
+    for (i = 0; i < 4; i++)
+        expected |= (uint32_t)input[in + i] << (8 * i);
+
+    success = (checksum == expected) ? 0 : 2;
+
+cleanup:
+    free(buffer);
+
+    return success;
+}
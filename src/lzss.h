@@ -0,0 +1,45 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LZSS_WINDOW 4096
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH 18
+#define LZSS_HASH_SIZE 4096
+#define LZSS_MAX_CHAIN 64
+#define LZSS_STREAM_BUFFER 65536
+
+// worst case: all literals, one flag byte per 8 of them, plus the checksum
+#define LZSS_BOUND(len) ((len) + ((len) + 7) / 8 + 4)
+
+
+uint32_t lzss_checksum(unsigned char *data, size_t len, bool signed_checksum);
+
+int lzss_compress(unsigned char *input, size_t in_len, unsigned char *output, size_t *out_len, bool signed_checksum);
+
+int lzss_decompress(unsigned char *input, size_t in_len, unsigned char *output, size_t out_len, bool signed_checksum);
+
+int lzss_decompress_file(unsigned char *input, size_t in_len, size_t out_len, FILE *f, bool signed_checksum);
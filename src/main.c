@@ -33,7 +33,10 @@
 #include "derapify.h"
 #include "filesystem.h"
 #include "keygen.h"
+#include "material.h"
+#include "model_config.h"
 #include "sign.h"
+#include "verify.h"
 
 
 void print_usage() {
@@ -46,10 +49,12 @@ void print_usage() {
            "    armake unpack [-f] [-i <includepattern>] [-x <excludepattern>] <pbo> <folder>\n"
            "    armake cat <pbo> <name>\n"
            "    armake derapify [-f] [-d <indentation>] [<source> [<target>]]\n"
-           "    armake keygen [-f] <keyname>\n"
-           "    armake sign [-f] [-s <signature>] <privatekey> <pbo>\n"
-           "    armake paa2img [-f] <source> <target>\n"
-           "    armake img2paa [-f] [-z] [-t <paatype>] <source> <target>\n"
+           "    armake keygen [-f] <keyname>...\n"
+           "    armake sign [-f] [-s <signature>] <privatekey> <pbo>...\n"
+           "    armake verify <publickey> <pbo> [<signature>]\n"
+           "    armake verify <publickey> (<pbo> | <folder>)...\n"
+           "    armake paa2img [-f] [-b] [-m <mip>] [-M <maxsize>] <source> <target>\n"
+           "    armake img2paa [-f] [-z] [-b] [-t <paatype>] [-q <quality>] [-l <level>] [-r <resize>] <source> <target>\n"
            "    armake (-h | --help)\n"
            "    armake (-v | --version)\n"
            "\n"
@@ -60,8 +65,9 @@ void print_usage() {
            "    unpack      Unpack a PBO into a folder.\n"
            "    cat         Read the named file from the target PBO to stdout.\n"
            "    derapify    Derapify a config. Pass no target for stdout and no source for stdin.\n"
-           "    keygen      Generate a keypair with the specified path (extensions are added).\n"
-           "    sign        Sign a PBO with the given private key.\n"
+           "    keygen      Generate a keypair for each of the specified paths (extensions are added).\n"
+           "    sign        Sign PBOs with the given private key.\n"
+           "    verify      Verify the signatures of PBOs, or all PBOs in a folder, with the given public key.\n"
            "    paa2img     Convert PAA to image (PNG only).\n"
            "    img2paa     Convert image to PAA.\n"
            "\n"
@@ -79,8 +85,17 @@ void print_usage() {
            "    -s --signature  Signature name to use for signing the PBO.\n"
            "    -d --indent     String to use for indentation. "    " (4 spaces) by default.\n"
            "    -z --compress   Compress final PAA where possible.\n"
+           "    -b --batch      Convert all images in the source folder into the target folder.\n"
+           "                        Only outdated targets are converted unless --force is set.\n"
            "    -t --type       PAA type. One of: DXT1, DXT3, DXT5, ARGB4444, ARGB1555, AI88\n"
-           "                        Currently only DXT1 and DXT5 are implemented.\n"
+           "                        DXT3 is not implemented yet.\n"
+           "    -q --quality    DXT compression quality. One of: high, fast (default: high)\n"
+           "    -m --mip        Index of the MipMap to export, 0 being the full resolution.\n"
+           "    -M --max-size   Export the largest MipMap not exceeding this width and height.\n"
+           "    -l --level      LZO compression level for -z. One of: fast, best (default: fast)\n"
+           "    -r --resize     Fix invalid image dimensions. One of:\n"
+           "                        pad: repeat the last column/row up to a multiple of 4\n"
+           "                        scale: resample to the nearest power of two\n"
            "    -h --help       Show usage information and exit.\n"
            "    -v --version    Print the version number and exit.\n"
            "\n"
@@ -120,14 +135,20 @@ int read_args(int argc, char *argv[]) {
     const struct arg_option bool_options[] = {
         { "-f", "--force", &args.force, NULL },
         { "-p", "--packonly", &args.packonly, NULL },
-        { "-z", "--compress", &args.compress, NULL }
+        { "-z", "--compress", &args.compress, NULL },
+        { "-b", "--batch", &args.batch, NULL }
     };
 
     const struct arg_option single_options[] = {
         { "-k", "--key", &args.privatekey, NULL },
         { "-s", "--signature", &args.signature, NULL },
         { "-d", "--indent", &args.indent, NULL },
-        { "-t", "--type", &args.paatype, NULL }
+        { "-t", "--type", &args.paatype, NULL },
+        { "-q", "--quality", &args.quality, NULL },
+        { "-l", "--level", &args.level, NULL },
+        { "-r", "--resize", &args.resize, NULL },
+        { "-m", "--mip", &args.mip, NULL },
+        { "-M", "--max-size", &args.maxsize, NULL }
     };
 
     const struct arg_option multi_options[] = {
@@ -239,7 +260,9 @@ int main(int argc, char *argv[]) {
             args.includefolders[i][strlen(args.includefolders[i]) - 1] = 0;
     }
 
-    if (args.num_positionals == 0 || args.num_positionals > 3)
+    // only keygen, sign and verify take a variable number of positionals
+    if (args.num_positionals == 0 || (args.num_positionals > 3 && strcmp(args.positionals[0], "keygen") != 0 &&
+            strcmp(args.positionals[0], "sign") != 0 && strcmp(args.positionals[0], "verify") != 0))
         goto error;
 
     if (strcmp(args.positionals[0], "binarize") == 0)
@@ -258,6 +281,8 @@ int main(int argc, char *argv[]) {
         success = cmd_keygen();
     else if (strcmp(args.positionals[0], "sign") == 0)
         success = cmd_sign();
+    else if (strcmp(args.positionals[0], "verify") == 0)
+        success = cmd_verify();
     else if (strcmp(args.positionals[0], "paa2img") == 0)
         success = cmd_paa2img();
     else if (strcmp(args.positionals[0], "img2paa") == 0)
@@ -272,6 +297,9 @@ error:
     print_usage();
 
 done:
+    free_material_cache();
+    free_model_config_cache();
+
     if (args.positionals)
         free(args.positionals);
     if (args.mutedwarnings)
@@ -239,16 +239,160 @@ const struct shader_ref vertexshaders[45] = {
 };
 
 
+struct material_cache_entry *material_cache = NULL;
+int num_cached_materials = 0;
+
+// open addressing hash tables of cache entry indices, by name and by resolved path
+int *material_names_index = NULL;
+int *material_paths_index = NULL;
+uint32_t material_index_size = 0;
+
+
+void copy_material(struct material *target, struct material *source) {
+    /*
+     * Copies all material information from source to target, except for
+     * the path, which stays as referenced by the model. The texture and
+     * transform arrays are duplicated.
+     */
+
+    char path[2048];
+
+    strcpy(path, target->path);
+    memcpy(target, source, sizeof(struct material));
+    strcpy(target->path, path);
+
+    target->textures = (struct stage_texture *)safe_malloc(sizeof(struct stage_texture) * source->num_textures);
+    memcpy(target->textures, source->textures, sizeof(struct stage_texture) * source->num_textures);
+
+    target->transforms = (struct stage_transform *)safe_malloc(sizeof(struct stage_transform) * source->num_transforms);
+    memcpy(target->transforms, source->transforms, sizeof(struct stage_transform) * source->num_transforms);
+}
+
+
+int find_cached_material(char *key, bool by_path) {
+    /*
+     * Looks up a cached material by the name it was referenced with or by
+     * its resolved path.
+     *
+     * Returns the index of the cache entry, -1 if it isn't cached.
+     */
+
+    int *index = by_path ? material_paths_index : material_names_index;
+    uint32_t mask;
+    uint32_t i;
+    char *entry_key;
+
+    if (material_index_size == 0)
+        return -1;
+
+    mask = material_index_size - 1;
+    for (i = hash_name(key) & mask; index[i] != -1; i = (i + 1) & mask) {
+        entry_key = by_path ? material_cache[index[i]].actual_path : material_cache[index[i]].name;
+        if (strcmp(entry_key, key) == 0)
+            return index[i];
+    }
+
+    return -1;
+}
+
+
+void index_cached_material(int entry) {
+    /*
+     * Adds a cache entry to the hash tables. A resolved path is only
+     * indexed the first time it is seen.
+     */
+
+    uint32_t mask = material_index_size - 1;
+    uint32_t i;
+
+    for (i = hash_name(material_cache[entry].name) & mask; material_names_index[i] != -1; i = (i + 1) & mask);
+    material_names_index[i] = entry;
+
+    if (material_cache[entry].actual_path == NULL ||
+            find_cached_material(material_cache[entry].actual_path, true) != -1)
+        return;
+
+    for (i = hash_name(material_cache[entry].actual_path) & mask; material_paths_index[i] != -1; i = (i + 1) & mask);
+    material_paths_index[i] = entry;
+}
+
+
+void cache_material(char *name, char *actual_path, struct material *material, int result) {
+    /*
+     * Adds a material to the cache, including failed lookups (result
+     * non-zero, actual_path NULL if the file wasn't found), so those aren't
+     * searched and rapified again for every reference.
+     */
+
+    struct material_cache_entry *entry;
+    int i;
+
+    if (num_cached_materials % MATERIALCACHEINTERVAL == 0) {
+        material_cache = (struct material_cache_entry *)safe_realloc(material_cache,
+            sizeof(struct material_cache_entry) * (num_cached_materials + MATERIALCACHEINTERVAL));
+    }
+
+    entry = &material_cache[num_cached_materials++];
+
+    entry->name = safe_strdup(name);
+    entry->actual_path = (actual_path == NULL) ? NULL : safe_strdup(actual_path);
+    entry->result = result;
+    entry->material.path[0] = 0;
+    copy_material(&entry->material, material);
+
+    // keep the tables at most half full, rebuilding them when growing
+    if (num_cached_materials * 2 > material_index_size) {
+        material_index_size = (material_index_size == 0) ? MATERIALCACHEINTERVAL * 2 : material_index_size * 2;
+
+        free(material_names_index);
+        free(material_paths_index);
+        material_names_index = (int *)safe_malloc(sizeof(int) * material_index_size);
+        material_paths_index = (int *)safe_malloc(sizeof(int) * material_index_size);
+        memset(material_names_index, 0xff, sizeof(int) * material_index_size);
+        memset(material_paths_index, 0xff, sizeof(int) * material_index_size);
+
+        for (i = 0; i < num_cached_materials; i++)
+            index_cached_material(i);
+    } else {
+        index_cached_material(num_cached_materials - 1);
+    }
+}
+
+
+int use_cached_material(struct material *material, int entry) {
+    /*
+     * Copies a cached material into the given one, repeating the warning
+     * if the cached lookup failed.
+     *
+     * Returns the result of the cached lookup.
+     */
+
+    extern char *current_target;
+    struct material_cache_entry *cached = &material_cache[entry];
+
+    copy_material(material, &cached->material);
+
+    if (cached->result == 1)
+        lwarningf(current_target, -1, "Failed to find material \"%s\".\n", cached->name);
+    else if (cached->result)
+        lwarningf(cached->actual_path, -1, "Failed to rapify %s.\n", cached->actual_path);
+
+    return cached->result;
+}
+
+
 int read_material(struct material *material) {
     /*
      * Reads the material information for the given material struct.
+     * Materials are cached by their resolved path for the lifetime of the
+     * process, so every rvmat is only rapified and parsed once per build.
+     *
      * Returns 0 on success and a positive integer on failure.
      */
 
     extern char *current_target;
     FILE *f;
     char actual_path[2048];
-    char rapified_path[2048];
     char config_path[2048];
     char temp[2048];
     char shader[2048];
@@ -262,6 +406,11 @@ int read_material(struct material *material) {
         strcpy(temp, material->path);
     }
 
+    // Check the cache by name first, this saves us the file search
+    i = find_cached_material(temp, false);
+    if (i != -1)
+        return use_cached_material(material, i);
+
     // Write default values
     material->type = MATERIALTYPE;
     material->depr_1 = 1;
@@ -298,29 +447,31 @@ int read_material(struct material *material) {
 
     if (find_file(temp, "", actual_path)) {
         lwarningf(current_target, -1, "Failed to find material \"%s\".\n", temp);
+        cache_material(temp, NULL, material, 1);
         return 1;
     }
 
-    current_target = temp;
+    i = find_cached_material(actual_path, true);
+    if (i != -1) {
+        free(material->textures);
+        free(material->transforms);
+        i = use_cached_material(material, i);
+        cache_material(temp, actual_path, material, i);
+        return i;
+    }
 
-    strcpy(rapified_path, actual_path);
-    strcat(rapified_path, ".armake.bin"); // it is assumed that this doesn't exist
+    current_target = temp;
 
     // Rapify file
-    if (rapify_file(actual_path, rapified_path)) {
+    if (rapify_temp(actual_path, &f)) {
         lwarningf(current_target, -1, "Failed to rapify %s.\n", actual_path);
+        current_target = material->path;
+        cache_material(temp, actual_path, material, 2);
         return 2;
     }
 
     current_target = material->path;
 
-    // Open rapified file
-    f = fopen(rapified_path, "rb");
-    if (!f) {
-        lwarningf(current_target, -1, "Failed to open rapified material.\n");
-        return 3;
-    }
-
     // Read colors
     read_float_array(f, "emmisive", (float *)&material->emissive, 4); // "Did you mean: emissive?"
     read_float_array(f, "ambient", (float *)&material->ambient, 4);
@@ -359,7 +510,7 @@ int read_material(struct material *material) {
     // Read stages
     for (i = 1; i < MAXSTAGES; i++) {
         snprintf(config_path, sizeof(config_path), "Stage%i >> texture", i);
-        if (read_string(f, config_path, temp, sizeof(temp)))
+        if (read_string(f, config_path, shader, sizeof(shader)))
             break;
         material->num_textures++;
         material->num_transforms++;
@@ -405,10 +556,30 @@ int read_material(struct material *material) {
 
     // Clean up
     fclose(f);
-    if (remove_file(rapified_path)) {
-        lwarningf(current_target, -1, "Failed to remove temporary material.\n");
-        return 4;
-    }
+
+    cache_material(temp, actual_path, material, 0);
 
     return 0;
 }
+
+
+void free_material_cache() {
+    int i;
+
+    for (i = 0; i < num_cached_materials; i++) {
+        free(material_cache[i].name);
+        free(material_cache[i].actual_path);
+        free(material_cache[i].material.textures);
+        free(material_cache[i].material.transforms);
+    }
+
+    free(material_cache);
+    free(material_names_index);
+    free(material_paths_index);
+
+    material_cache = NULL;
+    num_cached_materials = 0;
+    material_names_index = NULL;
+    material_paths_index = NULL;
+    material_index_size = 0;
+}
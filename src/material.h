@@ -21,6 +21,7 @@
 
 #define MATERIALTYPE 11
 #define MAXSTAGES 16
+#define MATERIALCACHEINTERVAL 32
 
 
 #include "utils.h"
@@ -74,5 +75,24 @@ struct material {
     struct stage_texture dummy_texture;
 };
 
+struct material_cache_entry {
+    char *name;
+    char *actual_path;
+    int result;
+    struct material material;
+};
+
+
+void copy_material(struct material *target, struct material *source);
+
+int find_cached_material(char *key, bool by_path);
+
+void index_cached_material(int entry);
+
+void cache_material(char *name, char *actual_path, struct material *material, int result);
+
+int use_cached_material(struct material *material, int entry);
 
 int read_material(struct material *material);
+
+void free_material_cache();
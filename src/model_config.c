@@ -31,7 +31,70 @@
 #include "model_config.h"
 
 
-int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
+struct model_config_cache_entry *model_config_cache = NULL;
+int num_cached_model_configs = 0;
+
+
+char *intern_name(struct skeleton *skeleton, char *name) {
+    /*
+     * Returns the skeleton's copy of the given name, adding it first if
+     * necessary. Bones, sections and animations reference the same few
+     * selection names over and over, so each is only stored once.
+     */
+
+    char **names;
+    uint32_t names_size;
+    uint32_t mask;
+    uint32_t i;
+    uint32_t j;
+
+    if ((skeleton->num_names + 1) * 2 > skeleton->names_size) {
+        names = skeleton->names;
+        names_size = skeleton->names_size;
+
+        skeleton->names_size = (names_size == 0) ? NAMESINTERVAL : names_size * 2;
+        skeleton->names = (char **)safe_malloc(sizeof(char *) * skeleton->names_size);
+        memset(skeleton->names, 0, sizeof(char *) * skeleton->names_size);
+
+        mask = skeleton->names_size - 1;
+        for (i = 0; i < names_size; i++) {
+            if (names[i] == NULL)
+                continue;
+            for (j = hash_name(names[i]) & mask; skeleton->names[j] != NULL; j = (j + 1) & mask);
+            skeleton->names[j] = names[i];
+        }
+
+        free(names);
+    }
+
+    mask = skeleton->names_size - 1;
+    for (i = hash_name(name) & mask; skeleton->names[i] != NULL; i = (i + 1) & mask) {
+        if (strcmp(skeleton->names[i], name) == 0)
+            return skeleton->names[i];
+    }
+
+    skeleton->names[i] = safe_strdup(name);
+    skeleton->num_names++;
+
+    return skeleton->names[i];
+}
+
+
+void free_skeleton(struct skeleton *skeleton) {
+    int i;
+
+    for (i = 0; i < skeleton->names_size; i++)
+        free(skeleton->names[i]);
+
+    free(skeleton->names);
+    free(skeleton->bones);
+    free(skeleton->sections);
+    free(skeleton->animations);
+    free(skeleton);
+}
+
+
+int read_animations(struct class *config, char *config_path, struct skeleton *skeleton) {
     /*
      * Reads the animation subclasses of the given config path into the struct
      * array.
@@ -42,24 +105,21 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
 
     int i;
     int j;
-    int k;
     int success;
     char parent[2048];
     char containing[2048];
     char value_path[2048];
     char value[2048];
+    char *anim_names;
+    char *anim_name;
 
     // Run the function for the parent class first
-    fseek(f, 16, SEEK_SET);
-    success = seek_config_path(f, config_path);
-    if (success > 0) {
-        return success;
-    } else if (success == 0) {
-        success = find_parent(f, config_path, parent, sizeof(parent));
+    if (find_config_entry(config, config_path) != NULL) {
+        success = find_config_parent(config, config_path, parent, sizeof(parent));
         if (success > 0) {
             return 2;
         } else if (success == 0) {
-            success = read_animations(f, parent, skeleton);
+            success = read_animations(config, parent, skeleton);
             if (success > 0)
                 return success;
         }
@@ -68,58 +128,61 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
     // Check parent CfgModels entry
     strcpy(containing, config_path);
     *(strrchr(containing, '>') - 2) = 0;
-    success = find_parent(f, containing, parent, sizeof(parent));
+    success = find_config_parent(config, containing, parent, sizeof(parent));
     if (success > 0) {
         return 2;
     } else if (success == 0) {
         strcat(parent, " >> Animations");
-        success = read_animations(f, parent, skeleton);
+        success = read_animations(config, parent, skeleton);
         if (success > 0)
             return success;
     }
 
-    fseek(f, 16, SEEK_SET);
-    success = seek_config_path(f, config_path);
-    if (success < 0)
+    if (find_config_entry(config, config_path) == NULL)
         return -1;
 
     // Now go through all the animations
-    char anim_names[MAXANIMS][512];
-    for (i = 0; i < MAXANIMS; i++)
-        anim_names[i][0] = 0;
+    anim_names = (char *)safe_malloc(MAXANIMS * 512);
+    memset(anim_names, 0, MAXANIMS * 512);
 
-    success = read_classes(f, config_path, (char *)anim_names, MAXANIMS, 512);
-    if (success)
+    success = read_config_classes(config, config_path, anim_names, MAXANIMS, 512);
+    if (success) {
+        free(anim_names);
         return success;
+    }
 
     for (i = 0; i < MAXANIMS; i++) {
-        if (strlen(anim_names[i]) == 0)
+        anim_name = anim_names + i * 512;
+        if (strlen(anim_name) == 0)
             break;
 
-        for (j = 0; j < MAXANIMS; j++) {
-            if (strlen(skeleton->animations[j].name) == 0)
-                break;
-            if (strcmp(skeleton->animations[j].name, anim_names[i]) == 0)
+        for (j = 0; j < skeleton->num_animations; j++) {
+            if (strcmp(skeleton->animations[j].name, anim_name) == 0)
                 break;
         }
-        if (j == MAXANIMS)
-            return 1;
 
         if (j == skeleton->num_animations) {
+            skeleton->animations = (struct animation *)safe_realloc(skeleton->animations,
+                sizeof(struct animation) * (skeleton->num_animations + 1));
+            memset(&skeleton->animations[j], 0, sizeof(struct animation));
+            skeleton->animations[j].selection = intern_name(skeleton, "");
+            skeleton->animations[j].source = skeleton->animations[j].selection;
+            skeleton->animations[j].axis = skeleton->animations[j].selection;
+            skeleton->animations[j].begin = skeleton->animations[j].selection;
+            skeleton->animations[j].end = skeleton->animations[j].selection;
             skeleton->num_animations++;
         } else {
-            for (k = j; k < skeleton->num_animations - 1; k++) {
-                memcpy(&skeleton->animations[k], &skeleton->animations[k + 1], sizeof(struct animation));
-            }
+            memmove(&skeleton->animations[j], &skeleton->animations[j + 1],
+                sizeof(struct animation) * (skeleton->num_animations - 1 - j));
             j = skeleton->num_animations - 1;
         }
 
-        strcpy(skeleton->animations[j].name, anim_names[i]);
+        skeleton->animations[j].name = intern_name(skeleton, anim_name);
 
         // Read anim type
-        sprintf(value_path, "%s >> %s >> type", config_path, anim_names[i]);
-        if (read_string(f, value_path, value, sizeof(value))) {
-            lwarningf(current_target, -1, "Animation type for %s could not be found.\n", anim_names[i]);
+        sprintf(value_path, "%s >> %s >> type", config_path, anim_name);
+        if (read_config_string(config, value_path, value, sizeof(value))) {
+            lwarningf(current_target, -1, "Animation type for %s could not be found.\n", anim_name);
             continue;
         }
 
@@ -153,11 +216,6 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         }
 
         // Read optional values
-        skeleton->animations[j].source[0] = 0;
-        skeleton->animations[j].selection[0] = 0;
-        skeleton->animations[j].axis[0] = 0;
-        skeleton->animations[j].begin[0] = 0;
-        skeleton->animations[j].end[0] = 0;
         skeleton->animations[j].min_value = 0.0f;
         skeleton->animations[j].max_value = 1.0f;
         skeleton->animations[j].min_phase = 0.0f;
@@ -172,70 +230,67 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         skeleton->animations[j].hide_value = 0.0f;
         skeleton->animations[j].unhide_value = -1.0f;
 
-#define ERROR_READING(key) lwarningf(current_target, -1, "Error reading %s for %s.\n", key, anim_names[i]);
+#define ERROR_READING(key) lwarningf(current_target, -1, "Error reading %s for %s.\n", key, anim_name);
 
-        sprintf(value_path, "%s >> %s >> source", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].source, sizeof(skeleton->animations[j].source)) > 0)
-            ERROR_READING("source")
+#define READ_NAME(key, field) \
+        value[0] = 0; \
+        sprintf(value_path, "%s >> %s >> " key, config_path, anim_name); \
+        if (read_config_string(config, value_path, value, sizeof(value)) > 0) \
+            ERROR_READING(key) \
+        skeleton->animations[j].field = intern_name(skeleton, value);
 
-        sprintf(value_path, "%s >> %s >> selection", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].selection, sizeof(skeleton->animations[j].selection)) > 0)
-            ERROR_READING("selection")
+        READ_NAME("source", source)
 
-        sprintf(value_path, "%s >> %s >> axis", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].axis, sizeof(skeleton->animations[j].axis)) > 0)
-            ERROR_READING("axis")
+        READ_NAME("selection", selection)
 
-        sprintf(value_path, "%s >> %s >> begin", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].begin, sizeof(skeleton->animations[j].begin)) > 0)
-            ERROR_READING("begin")
+        READ_NAME("axis", axis)
 
-        sprintf(value_path, "%s >> %s >> end", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].end, sizeof(skeleton->animations[j].end)) > 0)
-            ERROR_READING("end")
+        READ_NAME("begin", begin)
 
-        sprintf(value_path, "%s >> %s >> minValue", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].min_value) > 0)
+        READ_NAME("end", end)
+
+        sprintf(value_path, "%s >> %s >> minValue", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].min_value) > 0)
             ERROR_READING("minValue")
 
-        sprintf(value_path, "%s >> %s >> maxValue", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].max_value) > 0)
+        sprintf(value_path, "%s >> %s >> maxValue", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].max_value) > 0)
             ERROR_READING("maxValue")
 
-        sprintf(value_path, "%s >> %s >> minPhase", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].min_phase) > 0)
+        sprintf(value_path, "%s >> %s >> minPhase", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].min_phase) > 0)
             ERROR_READING("minPhase")
 
-        sprintf(value_path, "%s >> %s >> maxPhase", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].max_phase) > 0)
+        sprintf(value_path, "%s >> %s >> maxPhase", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].max_phase) > 0)
             ERROR_READING("maxPhase")
 
-        sprintf(value_path, "%s >> %s >> angle0", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].angle0) > 0)
+        sprintf(value_path, "%s >> %s >> angle0", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].angle0) > 0)
             ERROR_READING("angle0")
 
-        sprintf(value_path, "%s >> %s >> angle1", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].angle1) > 0)
+        sprintf(value_path, "%s >> %s >> angle1", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].angle1) > 0)
             ERROR_READING("angle1")
 
-        sprintf(value_path, "%s >> %s >> offset0", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].offset0) > 0)
+        sprintf(value_path, "%s >> %s >> offset0", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].offset0) > 0)
             ERROR_READING("offset0")
 
-        sprintf(value_path, "%s >> %s >> offset1", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].offset1) > 0)
+        sprintf(value_path, "%s >> %s >> offset1", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].offset1) > 0)
             ERROR_READING("offset1")
 
-        sprintf(value_path, "%s >> %s >> hideValue", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].hide_value) > 0)
+        sprintf(value_path, "%s >> %s >> hideValue", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].hide_value) > 0)
             ERROR_READING("hideValue")
 
-        sprintf(value_path, "%s >> %s >> unHideValue", config_path, anim_names[i]);
-        if (read_float(f, value_path, &skeleton->animations[j].unhide_value) > 0)
+        sprintf(value_path, "%s >> %s >> unHideValue", config_path, anim_name);
+        if (read_config_float(config, value_path, &skeleton->animations[j].unhide_value) > 0)
             ERROR_READING("unHideValue")
 
-        sprintf(value_path, "%s >> %s >> sourceAddress", config_path, anim_names[i]);
-        success = read_string(f, value_path, value, sizeof(value));
+        sprintf(value_path, "%s >> %s >> sourceAddress", config_path, anim_name);
+        success = read_config_string(config, value_path, value, sizeof(value));
         if (success > 0) {
             ERROR_READING("sourceAddress")
         } else if (success == 0) {
@@ -254,36 +309,36 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         }
     }
 
+    free(anim_names);
+
     return 0;
 }
 
 
-int sort_bones(struct bone *src, struct bone *tgt, int tgt_index, char *parent) {
+int sort_bones(struct bone *src, uint32_t num_bones, struct bone *tgt, int tgt_index, char *parent) {
     int i;
     int j;
 
-    for (i = 0; i < MAXBONES; i++) {
-        if (strlen(src[i].name) == 0)
-            continue;
+    for (i = 0; i < num_bones; i++) {
         if (strcmp(src[i].parent, parent) != 0)
             continue;
 
         memcpy(&tgt[tgt_index++], &src[i], sizeof(struct bone));
-        tgt_index = sort_bones(src, tgt, tgt_index, src[i].name);
+        tgt_index = sort_bones(src, num_bones, tgt, tgt_index, src[i].name);
     }
 
     if (strlen(parent) > 0)
         return tgt_index;
 
     // copy the remaining bones
-    for (i = 0; i < MAXBONES; i++) {
-        if (strlen(src[i].name) == 0)
-            break;
-        for (j = 0; j < MAXBONES; j++) {
+    for (i = 0; i < num_bones; i++) {
+        if (strlen(src[i].parent) == 0)
+            continue;
+        for (j = 0; j < tgt_index; j++) {
             if (strcmp(src[i].parent, tgt[j].name) == 0)
                 break;
         }
-        if (j == MAXBONES) {
+        if (j == tgt_index) {
             memcpy(&tgt[tgt_index], &src[i], sizeof(struct bone));
             tgt_index++;
         }
@@ -293,82 +348,35 @@ int sort_bones(struct bone *src, struct bone *tgt, int tgt_index, char *parent)
 }
 
 
-int read_model_config(char *path, struct skeleton *skeleton) {
+int read_model_entry(struct class *config, char *path, char *model_name, struct skeleton *skeleton) {
     /*
-     * Reads the model config information for the given model path. If no
-     * model config is found, -1 is returned. 0 is returned on success
-     * and a positive integer on failure.
+     * Reads the CfgModels entry of the given model (and the skeleton it
+     * uses) from the parsed model config.
+     *
+     * Returns 0 on success and a positive integer on failure.
      */
 
-    extern char *current_target;
-    FILE *f;
     int i;
     int success;
-    char model_config_path[2048];
-    char rapified_path[2048];
     char config_path[2048];
-    char model_name[512];
-    char bones[MAXBONES * 2][512] = {};
     char buffer[512];
+    char *bones;
+    char *sections;
+    int num_sorted;
+    struct bone *bones_src;
     struct bone *bones_tmp;
 
-    current_target = path;
-
-    // Extract model.cfg path
-    strncpy(model_config_path, path, sizeof(model_config_path));
-    if (strrchr(model_config_path, PATHSEP) != NULL)
-        strcpy(strrchr(model_config_path, PATHSEP) + 1, "model.cfg");
-    else
-        strcpy(model_config_path, "model.cfg");
-
-    strcpy(rapified_path, model_config_path);
-    strcat(rapified_path, ".armake.bin"); // it is assumed that this doesn't exist
-
-    if (access(model_config_path, F_OK) == -1)
-        return -1;
-
-    // Rapify file
-    success = rapify_file(model_config_path, rapified_path);
-    if (success) {
-        errorf("Failed to rapify model config.\n");
-        return 1;
-    }
-
-    current_target = path;
-
-    // Extract model name and convert to lower case
-    if (strrchr(path, PATHSEP) != NULL)
-        strcpy(model_name, strrchr(path, PATHSEP) + 1);
-    else
-        strcpy(model_name, path);
-    *strrchr(model_name, '.') = 0;
-
-    lower_case(model_name);
-
-    // Open rapified file
-    f = fopen(rapified_path, "rb");
-    if (!f) {
-        errorf("Failed to open model config.\n");
-        return 2;
-    }
-
     // Check if model entry even exists
     sprintf(config_path, "CfgModels >> %s", model_name);
-    fseek(f, 16, SEEK_SET);
-    success = seek_config_path(f, config_path);
-    if (success > 0) {
-        errorf("Failed to find model config entry.\n");
-        return success;
-    } else if (success < 0) {
-        goto clean_up;
-    }
+    if (find_config_entry(config, config_path) == NULL)
+        return 0;
 
     if (strchr(model_name, '_') == NULL)
         lnwarningf(path, -1, "model-without-prefix", "Model has a model config entry but doesn't seem to have a prefix (missing _).\n");
 
     // Read name
     sprintf(config_path, "CfgModels >> %s >> skeletonName", model_name);
-    success = read_string(f, config_path, skeleton->name, sizeof(skeleton->name));
+    success = read_config_string(config, config_path, skeleton->name, sizeof(skeleton->name));
     if (success > 0) {
         errorf("Failed to read skeleton name.\n");
         return success;
@@ -377,7 +385,7 @@ int read_model_config(char *path, struct skeleton *skeleton) {
     // Read bones
     if (strlen(skeleton->name) > 0) {
         sprintf(config_path, "CfgSkeletons >> %s >> skeletonInherit", skeleton->name);
-        success = read_string(f, config_path, buffer, sizeof(buffer));
+        success = read_config_string(config, config_path, buffer, sizeof(buffer));
         if (success > 0) {
             errorf("Failed to read bones.\n");
             return success;
@@ -385,97 +393,127 @@ int read_model_config(char *path, struct skeleton *skeleton) {
 
         int32_t temp;
         sprintf(config_path, "CfgSkeletons >> %s >> isDiscrete", skeleton->name);
-        success = read_int(f, config_path, &temp);
+        success = read_config_int(config, config_path, &temp);
         if (success == 0)
             skeleton->is_discrete = (temp > 0);
         else
             skeleton->is_discrete = false;
 
+        bones = (char *)safe_malloc(MAXBONES * 2 * 512);
+        memset(bones, 0, MAXBONES * 2 * 512);
+
         i = 0;
         if (strlen(buffer) > 0) { // @todo: more than 1 parent
             sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", buffer);
-            success = read_string_array(f, config_path, (char *)bones, MAXBONES * 2, 512);
+            success = read_config_string_array(config, config_path, bones, MAXBONES * 2, 512);
             if (success > 0) {
                 errorf("Failed to read bones.\n");
+                free(bones);
                 return success;
             } else if (success == 0) {
                 for (i = 0; i < MAXBONES * 2; i += 2) {
-                    if (bones[i][0] == 0)
+                    if (bones[i * 512] == 0)
                         break;
                 }
             }
         }
 
         sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", skeleton->name);
-        success = read_string_array(f, config_path, (char *)bones + i * 512, MAXBONES * 2 - i, 512);
+        success = read_config_string_array(config, config_path, bones + i * 512, MAXBONES * 2 - i, 512);
         if (success > 0) {
             errorf("Failed to read bones.\n");
+            free(bones);
             return success;
         }
 
         for (i = 0; i < MAXBONES * 2; i += 2) {
-            if (bones[i][0] == 0)
+            if (bones[i * 512] == 0)
                 break;
-            strcpy(skeleton->bones[i / 2].name, bones[i]);
-            strcpy(skeleton->bones[i / 2].parent, bones[i + 1]);
-            skeleton->num_bones++;
         }
+        skeleton->num_bones = i / 2;
 
         // Sort bones by parent
-        bones_tmp = (struct bone *)safe_malloc(sizeof(struct bone) * MAXBONES);
-        memset(bones_tmp, 0, sizeof(struct bone) * MAXBONES);
+        bones_src = (struct bone *)safe_malloc(sizeof(struct bone) * skeleton->num_bones);
+        bones_tmp = (struct bone *)safe_malloc(sizeof(struct bone) * skeleton->num_bones);
 
-        sort_bones(skeleton->bones, bones_tmp, 0, "");
-        memcpy(skeleton->bones, bones_tmp, sizeof(struct bone) * MAXBONES);
+        for (i = 0; i < skeleton->num_bones; i++) {
+            bones_src[i].name = bones + (i * 2) * 512;
+            bones_src[i].parent = bones + (i * 2 + 1) * 512;
+        }
 
-        free(bones_tmp);
+        num_sorted = sort_bones(bones_src, skeleton->num_bones, bones_tmp, 0, "");
 
-        // Convert to lower case
-        for (i = 0; i < MAXBONES; i++) {
-            if (strlen(skeleton->bones[i].name) == 0)
-                break;
-            lower_case(skeleton->bones[i].name);
-            lower_case(skeleton->bones[i].parent);
+        // Convert to lower case, bones that couldn't be sorted stay empty
+        skeleton->bones = (struct bone *)safe_malloc(sizeof(struct bone) * skeleton->num_bones);
+        for (i = 0; i < skeleton->num_bones; i++) {
+            if (i >= num_sorted) {
+                skeleton->bones[i].name = intern_name(skeleton, "");
+                skeleton->bones[i].parent = skeleton->bones[i].name;
+                continue;
+            }
+
+            strcpy(buffer, bones_tmp[i].name);
+            lower_case(buffer);
+            skeleton->bones[i].name = intern_name(skeleton, buffer);
+
+            strcpy(buffer, bones_tmp[i].parent);
+            lower_case(buffer);
+            skeleton->bones[i].parent = intern_name(skeleton, buffer);
         }
+
+        free(bones_src);
+        free(bones_tmp);
+        free(bones);
     }
 
     // Read sections
     sprintf(config_path, "CfgModels >> %s >> sectionsInherit", model_name);
-    success = read_string(f, config_path, buffer, sizeof(buffer));
+    success = read_config_string(config, config_path, buffer, sizeof(buffer));
     if (success > 0) {
         errorf("Failed to read sections.\n");
         return success;
     }
 
+    sections = (char *)safe_malloc(MAXSECTIONS * 512);
+    memset(sections, 0, MAXSECTIONS * 512);
+
     i = 0;
     if (strlen(buffer) > 0) {
         sprintf(config_path, "CfgModels >> %s >> sections", buffer);
-        success = read_string_array(f, config_path, (char *)skeleton->sections, MAXSECTIONS, 512);
+        success = read_config_string_array(config, config_path, sections, MAXSECTIONS, 512);
         if (success > 0) {
             errorf("Failed to read sections.\n");
+            free(sections);
             return success;
         } else if (success == 0) {
             for (i = 0; i < MAXSECTIONS; i++) {
-                if (skeleton->sections[i][0] == 0)
+                if (sections[i * 512] == 0)
                     break;
             }
         }
     }
 
     sprintf(config_path, "CfgModels >> %s >> sections", model_name);
-    success = read_string_array(f, config_path, (char *)skeleton->sections + i * 512, MAXSECTIONS - i, 512);
+    success = read_config_string_array(config, config_path, sections + i * 512, MAXSECTIONS - i, 512);
     if (success > 0) {
         errorf("Failed to read sections.\n");
+        free(sections);
         return success;
     }
 
-    for (i = 0; i < MAXSECTIONS && skeleton->sections[i][0] != 0; i++)
+    for (i = 0; i < MAXSECTIONS && sections[i * 512] != 0; i++)
         skeleton->num_sections++;
 
+    skeleton->sections = (char **)safe_malloc(sizeof(char *) * skeleton->num_sections);
+    for (i = 0; i < skeleton->num_sections; i++)
+        skeleton->sections[i] = intern_name(skeleton, sections + i * 512);
+
+    free(sections);
+
     // Read animations
     skeleton->num_animations = 0;
     sprintf(config_path, "CfgModels >> %s >> Animations", model_name);
-    success = read_animations(f, config_path, skeleton);
+    success = read_animations(config, config_path, skeleton);
     if (success > 0) {
         errorf("Failed to read animations.\n");
         return success;
@@ -486,25 +524,149 @@ int read_model_config(char *path, struct skeleton *skeleton) {
 
     // Read thermal stuff
     sprintf(config_path, "CfgModels >> %s >> htMin", model_name);
-    read_float(f, config_path, &skeleton->ht_min);
+    read_config_float(config, config_path, &skeleton->ht_min);
     sprintf(config_path, "CfgModels >> %s >> htMax", model_name);
-    read_float(f, config_path, &skeleton->ht_max);
+    read_config_float(config, config_path, &skeleton->ht_max);
     sprintf(config_path, "CfgModels >> %s >> afMax", model_name);
-    read_float(f, config_path, &skeleton->af_max);
+    read_config_float(config, config_path, &skeleton->af_max);
     sprintf(config_path, "CfgModels >> %s >> mfMax", model_name);
-    read_float(f, config_path, &skeleton->mf_max);
+    read_config_float(config, config_path, &skeleton->mf_max);
     sprintf(config_path, "CfgModels >> %s >> mfAct", model_name);
-    read_float(f, config_path, &skeleton->mf_act);
+    read_config_float(config, config_path, &skeleton->mf_act);
     sprintf(config_path, "CfgModels >> %s >> tBody", model_name);
-    read_float(f, config_path, &skeleton->t_body);
+    read_config_float(config, config_path, &skeleton->t_body);
+
+    return 0;
+}
+
 
-clean_up:
-    // Clean up
+
+
+int parse_model_config(char *path, struct class **result) {
+    /*
+     * Parses the given model config into a class tree. Configs that are
+     * already rapified are derapified next to the source first.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f;
+    char buffer[4];
+    char temp_path[2048];
+    bool is_rapified;
+    int success;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        errorf("Failed to open %s.\n", path);
+        return 1;
+    }
+
+    is_rapified = fread(buffer, 4, 1, f) == 1 && strncmp(buffer, "\0raP", 4) == 0;
     fclose(f);
-    if (remove_file(rapified_path)) {
-        errorf("Failed to remove temporary model config.\n");
-        return 3;
+
+    if (!is_rapified)
+        return parse_config(path, result);
+
+    if (strlen(path) + 12 > sizeof(temp_path)) {
+        errorf("Path for %s is too long.\n", path);
+        return 2;
     }
 
-    return 0;
+    strcpy(temp_path, path);
+    strcat(temp_path, ".armake.cpp");
+
+    success = derapify_file(path, temp_path);
+    if (success == 0)
+        success = parse_config(temp_path, result);
+
+    remove(temp_path);
+
+    return success ? 3 : 0;
+}
+
+
+int read_model_config(char *path, struct skeleton *skeleton) {
+    /*
+     * Reads the model config information for the given model path. If no
+     * model config is found, -1 is returned. 0 is returned on success
+     * and a positive integer on failure.
+     *
+     * The model.cfg of each folder is only parsed once, models sharing it
+     * read their entry straight from the parsed class tree.
+     */
+
+    extern char *current_target;
+    int i;
+    char model_config_path[2048];
+    char model_name[512];
+    struct class *config;
+
+    current_target = path;
+
+    // Extract model.cfg path
+    strncpy(model_config_path, path, sizeof(model_config_path));
+    if (strrchr(model_config_path, PATHSEP) != NULL)
+        strcpy(strrchr(model_config_path, PATHSEP) + 1, "model.cfg");
+    else
+        strcpy(model_config_path, "model.cfg");
+
+    if (access(model_config_path, F_OK) == -1)
+        return -1;
+
+    // Parse file, unless another model in the same folder already tried
+    for (i = 0; i < num_cached_model_configs; i++) {
+        if (strcmp(model_config_cache[i].path, model_config_path) == 0)
+            break;
+    }
+
+    if (i == num_cached_model_configs) {
+        // failures are cached too, so the config isn't parsed again for every model
+        if (parse_model_config(model_config_path, &config))
+            config = NULL;
+
+        if (num_cached_model_configs % MODELCONFIGCACHEINTERVAL == 0) {
+            model_config_cache = (struct model_config_cache_entry *)safe_realloc(model_config_cache,
+                sizeof(struct model_config_cache_entry) * (num_cached_model_configs + MODELCONFIGCACHEINTERVAL));
+        }
+
+        strcpy(model_config_cache[num_cached_model_configs].path, model_config_path);
+        model_config_cache[num_cached_model_configs].config = config;
+        num_cached_model_configs++;
+    }
+
+    config = model_config_cache[i].config;
+
+    current_target = path;
+
+    if (config == NULL) {
+        errorf("Failed to rapify model config.\n");
+        return 1;
+    }
+
+    // Extract model name and convert to lower case
+    if (strrchr(path, PATHSEP) != NULL)
+        strcpy(model_name, strrchr(path, PATHSEP) + 1);
+    else
+        strcpy(model_name, path);
+    *strrchr(model_name, '.') = 0;
+
+    lower_case(model_name);
+
+    return read_model_entry(config, path, model_name, skeleton);
+}
+
+
+void free_model_config_cache() {
+    int i;
+
+    for (i = 0; i < num_cached_model_configs; i++) {
+        if (model_config_cache[i].config != NULL)
+            free_class(model_config_cache[i].config);
+    }
+
+    free(model_config_cache);
+
+    model_config_cache = NULL;
+    num_cached_model_configs = 0;
 }
@@ -22,6 +22,8 @@
 #define MAXBONES 512
 #define MAXSECTIONS 1024
 #define MAXANIMS 1024
+#define MODELCONFIGCACHEINTERVAL 16
+#define NAMESINTERVAL 64
 
 #define TYPE_ROTATION      0
 #define TYPE_ROTATION_X    1
@@ -39,21 +41,24 @@
 #define SOURCE_MIRROR 2
 
 
+#include <stdio.h>
+
 #include "vector.h"
+#include "rapify.h"
 
 struct bone {
-    char name[512];
-    char parent[512];
+    char *name;
+    char *parent;
 };
 
 struct animation {
     uint32_t type;
-    char name[512];
-    char selection[512];
-    char source[512];
-    char axis[512];
-    char begin[512];
-    char end[512];
+    char *name;
+    char *selection;
+    char *source;
+    char *axis;
+    char *begin;
+    char *end;
     float min_value;
     float max_value;
     float min_phase;
@@ -76,11 +81,14 @@ struct animation {
 struct skeleton {
     char name[512];
     uint32_t num_bones;
-    struct bone bones[MAXBONES];
+    struct bone *bones;
     uint32_t num_sections;
-    char sections[MAXSECTIONS][512];
+    char **sections;
     uint32_t num_animations;
-    struct animation animations[MAXANIMS];
+    struct animation *animations;
+    uint32_t num_names;
+    uint32_t names_size;
+    char **names;
     bool is_discrete;
     float ht_min;
     float ht_max;
@@ -90,5 +98,20 @@ struct skeleton {
     float t_body;
 };
 
+struct model_config_cache_entry {
+    char path[2048];
+    struct class *config; // NULL if the model.cfg couldn't be parsed
+};
+
+
+char *intern_name(struct skeleton *skeleton, char *name);
+
+void free_skeleton(struct skeleton *skeleton);
+
+int read_model_entry(struct class *config, char *path, char *model_name, struct skeleton *skeleton);
+
+int parse_model_config(char *path, struct class **result);
 
 int read_model_config(char *path, struct skeleton *skeleton);
+
+void free_model_config_cache();
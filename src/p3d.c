@@ -566,13 +566,8 @@ uint32_t add_point(struct odol_lod *odol_lod, struct mlod_lod *mlod_lod, struct
         memset(&odol_lod->vertexboneref[odol_lod->num_points], 0, sizeof(struct odol_vertexboneref));
 
         for (i = model_info->skeleton->num_bones - 1; (int32_t)i >= 0; i--) {
-            for (j = 0; j < mlod_lod->num_selections; j++) {
-                if (stricmp(model_info->skeleton->bones[i].name,
-                        mlod_lod->selections[j].name) == 0)
-                    break;
-            }
-
-            if (j == mlod_lod->num_selections)
+            j = odol_lod->bone_to_selection[i];
+            if (j == NOPOINT)
                 continue;
 
             if (mlod_lod->selections[j].points[point_index_mlod] == 0)
@@ -682,6 +677,10 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     char *temp;
     bool *tileU;
     bool *tileV;
+    uint32_t *selection_faces;
+    uint32_t *selection_vertices;
+    uint8_t *selection_weights;
+    uint8_t weight;
     struct triplet normal;
     struct uv_pair uv_coords;
 
@@ -697,6 +696,19 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
         odol_lod->skeleton_to_subskeleton[i].links[0] = i;
     }
 
+    // Map bones to their selections once instead of for every vertex
+    odol_lod->bone_to_selection = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_bones_skeleton);
+
+    for (i = 0; i < model_info->skeleton->num_bones; i++) {
+        odol_lod->bone_to_selection[i] = NOPOINT;
+        for (j = 0; j < mlod_lod->num_selections; j++) {
+            if (stricmp(model_info->skeleton->bones[i].name, mlod_lod->selections[j].name) == 0) {
+                odol_lod->bone_to_selection[i] = j;
+                break;
+            }
+        }
+    }
+
     odol_lod->num_points_mlod = mlod_lod->num_points;
 
     odol_lod->face_area = 0;
@@ -1012,6 +1024,13 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     // Selections
     odol_lod->num_selections = mlod_lod->num_selections;
     odol_lod->selections = (struct odol_selection *)safe_malloc(sizeof(struct odol_selection) * odol_lod->num_selections);
+
+    // A selection can't have more members than the LOD, so one set of
+    // scratch buffers covers all of them.
+    selection_faces = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_faces);
+    selection_vertices = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_points);
+    selection_weights = (uint8_t *)safe_malloc(sizeof(uint8_t) * odol_lod->num_points);
+
     for (i = 0; i < odol_lod->num_selections; i++) {
         strcpy(odol_lod->selections[i].name, mlod_lod->selections[i].name);
         lower_case(odol_lod->selections[i].name);
@@ -1051,56 +1070,45 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
             odol_lod->selections[i].sections = 0;
         }
 
-        odol_lod->selections[i].num_faces = 0;
+        // Gather members into the scratch buffers with a running cursor,
+        // then copy them into exactly sized arrays.
+        k = 0;
         for (j = 0; j < odol_lod->num_faces; j++) {
             if (mlod_lod->selections[i].faces[j] > 0)
-                odol_lod->selections[i].num_faces++;
+                selection_faces[k++] = odol_lod->face_lookup[j];
         }
 
-        odol_lod->selections[i].faces = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->selections[i].num_faces);
-        for (j = 0; j < odol_lod->selections[i].num_faces; j++)
-            odol_lod->selections[i].faces[j] = NOPOINT;
-
-        for (j = 0; j < odol_lod->num_faces; j++) {
-            if (mlod_lod->selections[i].faces[j] == 0)
-                continue;
-
-            for (k = 0; k < odol_lod->selections[i].num_faces; k++) {
-                if (odol_lod->selections[i].faces[k] == NOPOINT)
-                    break;
-            }
-            odol_lod->selections[i].faces[k] = odol_lod->face_lookup[j];
-        }
+        odol_lod->selections[i].num_faces = k;
+        odol_lod->selections[i].faces = (uint32_t *)safe_malloc(sizeof(uint32_t) * k);
+        memcpy(odol_lod->selections[i].faces, selection_faces, sizeof(uint32_t) * k);
 
         odol_lod->selections[i].always_0 = 0;
 
-        odol_lod->selections[i].num_vertices = 0;
+        k = 0;
         for (j = 0; j < odol_lod->num_points; j++) {
-            if (mlod_lod->selections[i].points[odol_lod->vertex_to_point[j]] > 0)
-                odol_lod->selections[i].num_vertices++;
-        }
-
-        odol_lod->selections[i].num_vertex_weights = odol_lod->selections[i].num_vertices;
+            weight = mlod_lod->selections[i].points[odol_lod->vertex_to_point[j]];
+            if (weight == 0)
+                continue;
 
-        odol_lod->selections[i].vertices = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->selections[i].num_vertices);
-        for (j = 0; j < odol_lod->selections[i].num_vertices; j++)
-            odol_lod->selections[i].vertices[j] = NOPOINT;
+            selection_vertices[k] = j;
+            selection_weights[k] = weight;
+            k++;
+        }
 
-        odol_lod->selections[i].vertex_weights = (uint8_t *)safe_malloc(sizeof(uint8_t) * odol_lod->selections[i].num_vertex_weights);
+        odol_lod->selections[i].num_vertices = k;
+        odol_lod->selections[i].num_vertex_weights = k;
 
-        for (j = 0; j < odol_lod->num_points; j++) {
-            if (mlod_lod->selections[i].points[odol_lod->vertex_to_point[j]] == 0)
-                continue;
+        odol_lod->selections[i].vertices = (uint32_t *)safe_malloc(sizeof(uint32_t) * k);
+        memcpy(odol_lod->selections[i].vertices, selection_vertices, sizeof(uint32_t) * k);
 
-            for (k = 0; k < odol_lod->selections[i].num_vertices; k++) {
-                if (odol_lod->selections[i].vertices[k] == NOPOINT)
-                    break;
-            }
-            odol_lod->selections[i].vertices[k] = j;
-            odol_lod->selections[i].vertex_weights[k] = mlod_lod->selections[i].points[odol_lod->vertex_to_point[j]];
-        }
+        odol_lod->selections[i].vertex_weights = (uint8_t *)safe_malloc(sizeof(uint8_t) * k);
+        memcpy(odol_lod->selections[i].vertex_weights, selection_weights, sizeof(uint8_t) * k);
     }
 
+    free(selection_faces);
+    free(selection_vertices);
+    free(selection_weights);
+
     // Proxies
     odol_lod->num_proxies = 0;
     for (i = 0; i < mlod_lod->num_selections; i++) {
@@ -1691,7 +1699,7 @@ void write_animations(FILE *f_target, uint32_t num_lods, struct mlod_lod *mlod_l
             if (index == -1) {
                 if (i == 0) { // we only report errors for the first LOD
                     lnwarningf(current_target, -1, "unknown-bone", "Failed to find bone \"%s\" for animation \"%s\".\n",
-                            model_info->skeleton->bones[k].name, anim->name);
+                            anim->selection, anim->name);
                 }
                 continue;
             }
@@ -1857,6 +1865,7 @@ int mlod2odol(char *source, char *target) {
         free(odol_lod.proxies);
         free(odol_lod.subskeleton_to_skeleton);
         free(odol_lod.skeleton_to_subskeleton);
+        free(odol_lod.bone_to_selection);
         free(odol_lod.textures);
         free(odol_lod.point_to_vertex);
         free(odol_lod.vertex_to_point);
@@ -1945,7 +1954,7 @@ int mlod2odol(char *source, char *target) {
     free(mlod_lods);
 
     free(model_info.lod_resolutions);
-    free(model_info.skeleton);
+    free_skeleton(model_info.skeleton);
 
     return 0;
 }
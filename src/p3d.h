@@ -201,6 +201,7 @@ struct odol_lod {
     uint32_t *subskeleton_to_skeleton;
     uint32_t num_bones_skeleton;
     struct odol_bonelink *skeleton_to_subskeleton;
+    uint32_t *bone_to_selection;
     uint32_t num_points;
     uint32_t num_points_mlod;
     float face_area;
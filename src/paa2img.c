@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <math.h>
 
@@ -32,86 +33,219 @@
 #include <windows.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 #include "minilzo.h"
 
 #include "args.h"
 #include "utils.h"
+#include "filesystem.h"
+#include "lzss.h"
 #include "paa2img.h"
 
 
+int mipmap_length(uint16_t paatype, int width, int height) {
+    /* Returns the size of the uncompressed data of a mipmap. */
+
+    switch (paatype) {
+        case DXT1:
+            return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+        case DXT3:
+        case DXT5:
+            return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+        default:
+            return width * height * 2;
+    }
+}
+
+
+const unsigned char dxt_expand5[32] = {
+    0, 8, 16, 24, 32, 41, 49, 57, 65, 74, 82, 90, 98, 106, 115, 123,
+    131, 139, 148, 156, 164, 172, 180, 189, 197, 205, 213, 222, 230, 238, 246, 255
+};
+
+const unsigned char dxt_expand6[64] = {
+    0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60,
+    64, 68, 72, 76, 80, 85, 89, 93, 97, 101, 105, 109, 113, 117, 121, 125,
+    129, 133, 137, 141, 145, 149, 153, 157, 161, 165, 170, 174, 178, 182, 186, 190,
+    194, 198, 202, 206, 210, 214, 218, 222, 226, 230, 234, 238, 242, 246, 250, 255
+};
+
+
+void dxt_color_palette(unsigned char *block, unsigned char palette[4][4], unsigned char alpha) {
+    /*
+     * Expands the two 565 endpoints of a DXT color block into a 4 entry
+     * RGBA palette. The interpolated colors are always the 1/3 and 2/3
+     * ones, DXT1's three-color mode is not handled.
+     */
+
+    uint16_t c0;
+    uint16_t c1;
+    int i;
+
+    c0 = block[0] | (block[1] << 8);
+    c1 = block[2] | (block[3] << 8);
+
+    palette[0][0] = dxt_expand5[c0 >> 11];
+    palette[0][1] = dxt_expand6[(c0 >> 5) & 0x3f];
+    palette[0][2] = dxt_expand5[c0 & 0x1f];
+    palette[1][0] = dxt_expand5[c1 >> 11];
+    palette[1][1] = dxt_expand6[(c1 >> 5) & 0x3f];
+    palette[1][2] = dxt_expand5[c1 & 0x1f];
+
+    for (i = 0; i < 3; i++) {
+        palette[2][i] = (2 * palette[0][i] + 1 * palette[1][i]) / 3;
+        palette[3][i] = (1 * palette[0][i] + 2 * palette[1][i]) / 3;
+    }
+
+    for (i = 0; i < 4; i++)
+        palette[i][3] = alpha;
+}
+
+
+void dxt_alpha_palette(unsigned char *block, unsigned char palette[8]) {
+    /* Expands the two endpoints of a DXT5 alpha block into its palette. */
+
+    int a0;
+    int a1;
+    int i;
+
+    a0 = block[0];
+    a1 = block[1];
+
+    palette[0] = a0;
+    palette[1] = a1;
+
+    if (a0 > a1) {
+        for (i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+
+void dxt_decode_block(unsigned char *color_block, unsigned char *alpha_block, unsigned char *output, int stride) {
+    /*
+     * Decodes one DXT block into a 4x4 area of an RGBA image, one row of
+     * four pixels at a time. If alpha_block is NULL, the block is opaque
+     * (DXT1), otherwise the alpha is taken from the DXT5 alpha block.
+     */
+
+    unsigned char palette[4][4];
+    unsigned char alpha_palette[8];
+    uint64_t alpha_bits;
+    uint32_t alpha_row;
+    int x;
+    int y;
+#ifdef __SSE2__
+    __m128i colors[4];
+    __m128i shifts;
+    __m128i mask;
+    __m128i indices;
+    __m128i pixels;
+    __m128i alpha;
+    uint32_t packed;
+#else
+    unsigned char row[16];
+#endif
+
+    dxt_color_palette(color_block, palette, alpha_block ? 0 : 255);
+
+    alpha_bits = 0;
+    if (alpha_block) {
+        dxt_alpha_palette(alpha_block, alpha_palette);
+        for (x = 0; x < 6; x++)
+            alpha_bits |= (uint64_t)alpha_block[2 + x] << (8 * x);
+    }
+
+#ifdef __SSE2__
+    for (x = 0; x < 4; x++) {
+        memcpy(&packed, palette[x], 4);
+        colors[x] = _mm_set1_epi32(packed);
+    }
+
+    // moves the 2-bit index of pixel x to the top of its 16-bit lane
+    shifts = _mm_set_epi32(1, 4, 16, 64);
+    mask = _mm_set1_epi32(3);
+
+    for (y = 0; y < 4; y++) {
+        indices = _mm_mullo_epi16(_mm_set1_epi32(color_block[4 + y]), shifts);
+        indices = _mm_and_si128(_mm_srli_epi32(indices, 6), mask);
+
+        pixels = _mm_and_si128(_mm_cmpeq_epi32(indices, _mm_setzero_si128()), colors[0]);
+        for (x = 1; x < 4; x++)
+            pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_cmpeq_epi32(indices, _mm_set1_epi32(x)), colors[x]));
+
+        if (alpha_block) {
+            alpha_row = (alpha_bits >> (12 * y)) & 0xfff;
+            packed = 0;
+            for (x = 0; x < 4; x++)
+                packed |= (uint32_t)alpha_palette[(alpha_row >> (3 * x)) & 7] << (8 * x);
+
+            // spread the four alpha bytes into the top byte of each pixel
+            alpha = _mm_cvtsi32_si128(packed);
+            alpha = _mm_unpacklo_epi8(alpha, _mm_setzero_si128());
+            alpha = _mm_unpacklo_epi16(alpha, _mm_setzero_si128());
+            pixels = _mm_or_si128(pixels, _mm_slli_epi32(alpha, 24));
+        }
+
+        _mm_storeu_si128((__m128i *)(output + y * stride), pixels);
+    }
+#else
+    for (y = 0; y < 4; y++) {
+        for (x = 0; x < 4; x++)
+            memcpy(row + x * 4, palette[(color_block[4 + y] >> (2 * x)) & 3], 4);
+
+        if (alpha_block) {
+            alpha_row = (alpha_bits >> (12 * y)) & 0xfff;
+            for (x = 0; x < 4; x++)
+                row[x * 4 + 3] = alpha_palette[(alpha_row >> (3 * x)) & 7];
+        }
+
+        memcpy(output + y * stride, row, 16);
+    }
+#endif
+}
+
+
+void dxt_decode_partial_block(unsigned char *color_block, unsigned char *alpha_block, unsigned char *output, int stride, int width, int height) {
+    /*
+     * Decodes a block that sticks out of the image (in mips smaller than
+     * 4x4 or with odd dimensions), keeping only the width x height pixels
+     * inside it.
+     */
+
+    unsigned char block[64];
+    int y;
+
+    dxt_decode_block(color_block, alpha_block, block, 16);
+
+    for (y = 0; y < height; y++)
+        memcpy(output + y * stride, block + y * 16, width * 4);
+}
+
+
 int dxt12img(unsigned char *input, unsigned char *output, int width, int height) {
     /* Convert DXT1 data into a PNG image array. */
 
-    int i;
-    int j;
-    uint8_t c[4][3];
-    unsigned int clookup[16];
-    unsigned int x, y, index;
-
-    struct dxt1block {
-        uint16_t c0 : 16;
-        uint16_t c1 : 16;
-        uint8_t cl3 : 2;
-        uint8_t cl2 : 2;
-        uint8_t cl1 : 2;
-        uint8_t cl0 : 2;
-        uint8_t cl7 : 2;
-        uint8_t cl6 : 2;
-        uint8_t cl5 : 2;
-        uint8_t cl4 : 2;
-        uint8_t cl11 : 2;
-        uint8_t cl10 : 2;
-        uint8_t cl9 : 2;
-        uint8_t cl8 : 2;
-        uint8_t cl15 : 2;
-        uint8_t cl14 : 2;
-        uint8_t cl13 : 2;
-        uint8_t cl12 : 2;
-    } block;
-
-    for (i = 0; i < (width * height) / 2; i += 8) {
-        memcpy(&block, input + i, 8);
-
-        c[0][0] = 255 * ((63488 & block.c0) >> 11) / 31;
-        c[0][1] = 255 * ((2016 & block.c0) >> 5) / 63;
-        c[0][2] = 255 * (31 & block.c0) / 31;
-        c[1][0] = 255 * ((63488 & block.c1) >> 11) / 31;
-        c[1][1] = 255 * ((2016 & block.c1) >> 5) / 63;
-        c[1][2] = 255 * (31 & block.c1) / 31;
-        c[2][0] = (2 * c[0][0] + 1 * c[1][0]) / 3;
-        c[2][1] = (2 * c[0][1] + 1 * c[1][1]) / 3;
-        c[2][2] = (2 * c[0][2] + 1 * c[1][2]) / 3;
-        c[3][0] = (1 * c[0][0] + 2 * c[1][0]) / 3;
-        c[3][1] = (1 * c[0][1] + 2 * c[1][1]) / 3;
-        c[3][2] = (1 * c[0][2] + 2 * c[1][2]) / 3;
-
-        clookup[0] = block.cl0;
-        clookup[1] = block.cl1;
-        clookup[2] = block.cl2;
-        clookup[3] = block.cl3;
-        clookup[4] = block.cl4;
-        clookup[5] = block.cl5;
-        clookup[6] = block.cl6;
-        clookup[7] = block.cl7;
-        clookup[8] = block.cl8;
-        clookup[9] = block.cl9;
-        clookup[10] = block.cl10;
-        clookup[11] = block.cl11;
-        clookup[12] = block.cl12;
-        clookup[13] = block.cl13;
-        clookup[14] = block.cl14;
-        clookup[15] = block.cl15;
-
-        for (j = 0; j < 16; j++) {
-            x = ((i / 8) % (width / 4)) * 4 + 3 - (j % 4);
-            y = ((i / 8) / (width / 4)) * 4 + (j / 4);
-            index = (y * width + x) * 4;
-            *(output + index + 0) = c[clookup[j]][0];
-            *(output + index + 1) = c[clookup[j]][1];
-            *(output + index + 2) = c[clookup[j]][2];
-            *(output + index + 3) = 255;
+    int x;
+    int y;
+
+    for (y = 0; y < height; y += 4) {
+        for (x = 0; x < width; x += 4) {
+            if (x + 4 <= width && y + 4 <= height)
+                dxt_decode_block(input, NULL, output + (y * width + x) * 4, width * 4);
+            else
+                dxt_decode_partial_block(input, NULL, output + (y * width + x) * 4, width * 4, MIN(4, width - x), MIN(4, height - y));
+            input += 8;
         }
     }
 
@@ -122,118 +256,16 @@ int dxt12img(unsigned char *input, unsigned char *output, int width, int height)
 int dxt52img(unsigned char *input, unsigned char *output, int width, int height) {
     /* Convert DXT5 data into a PNG image array. */
 
-    int i;
-    int j;
-    uint8_t a[8];
-    unsigned int alookup[16];
-    uint8_t c[4][3];
-    unsigned int clookup[16];
-    unsigned int x, y, index;
-
-    /* For some reason, directly unpacking the alpha lookup table into the 16
-     * 3-bit arrays didn't work, so i'm reading it into one 64bit integer and
-     * unpacking it manually later. @todo */
-    struct dxt5block {
-        uint8_t a0 : 8;
-        uint8_t a1 : 8;
-        uint64_t al : 48;
-        uint16_t c0 : 16;
-        uint16_t c1 : 16;
-        uint8_t cl3 : 2;
-        uint8_t cl2 : 2;
-        uint8_t cl1 : 2;
-        uint8_t cl0 : 2;
-        uint8_t cl7 : 2;
-        uint8_t cl6 : 2;
-        uint8_t cl5 : 2;
-        uint8_t cl4 : 2;
-        uint8_t cl11 : 2;
-        uint8_t cl10 : 2;
-        uint8_t cl9 : 2;
-        uint8_t cl8 : 2;
-        uint8_t cl15 : 2;
-        uint8_t cl14 : 2;
-        uint8_t cl13 : 2;
-        uint8_t cl12 : 2;
-    } block;
-
-    for (i = 0; i < width * height; i += 16) {
-        memcpy(&block, input + i, 16);
-
-        a[0] = block.a0;
-        a[1] = block.a1;
-        if (block.a0 > block.a1) {
-            a[2] = (6 * block.a0 + 1 * block.a1) / 7;
-            a[3] = (5 * block.a0 + 2 * block.a1) / 7;
-            a[4] = (4 * block.a0 + 3 * block.a1) / 7;
-            a[5] = (3 * block.a0 + 4 * block.a1) / 7;
-            a[6] = (2 * block.a0 + 5 * block.a1) / 7;
-            a[7] = (1 * block.a0 + 6 * block.a1) / 7;
-        } else {
-            a[2] = (4 * block.a0 + 1 * block.a1) / 5;
-            a[3] = (3 * block.a0 + 2 * block.a1) / 5;
-            a[4] = (2 * block.a0 + 3 * block.a1) / 5;
-            a[5] = (1 * block.a0 + 4 * block.a1) / 5;
-            a[6] = 0;
-            a[7] = 255;
-        }
+    int x;
+    int y;
 
-        // This is ugly, retarded and shouldn't be necessary. See above.
-        alookup[0]  = (block.al & 3584) >> 9;
-        alookup[1]  = (block.al & 448) >> 6;
-        alookup[2]  = (block.al & 56) >> 3;
-        alookup[3]  = (block.al & 7) >> 0;
-        alookup[4]  = (block.al & 14680064) >> 21;
-        alookup[5]  = (block.al & 1835008) >> 18;
-        alookup[6]  = (block.al & 229376) >> 15;
-        alookup[7]  = (block.al & 28672) >> 12;
-        alookup[8]  = (block.al & 60129542144) >> 33;
-        alookup[9]  = (block.al & 7516192768) >> 30;
-        alookup[10] = (block.al & 939524096) >> 27;
-        alookup[11] = (block.al & 117440512) >> 24;
-        alookup[12] = (block.al & 246290604621824) >> 45;
-        alookup[13] = (block.al & 30786325577728) >> 42;
-        alookup[14] = (block.al & 3848290697216) >> 39;
-        alookup[15] = (block.al & 481036337152) >> 36;
-
-        c[0][0] = 255 * ((63488 & block.c0) >> 11) / 31;
-        c[0][1] = 255 * ((2016 & block.c0) >> 5) / 63;
-        c[0][2] = 255 * (31 & block.c0) / 31;
-        c[1][0] = 255 * ((63488 & block.c1) >> 11) / 31;
-        c[1][1] = 255 * ((2016 & block.c1) >> 5) / 63;
-        c[1][2] = 255 * (31 & block.c1) / 31;
-        c[2][0] = (2 * c[0][0] + 1 * c[1][0]) / 3;
-        c[2][1] = (2 * c[0][1] + 1 * c[1][1]) / 3;
-        c[2][2] = (2 * c[0][2] + 1 * c[1][2]) / 3;
-        c[3][0] = (1 * c[0][0] + 2 * c[1][0]) / 3;
-        c[3][1] = (1 * c[0][1] + 2 * c[1][1]) / 3;
-        c[3][2] = (1 * c[0][2] + 2 * c[1][2]) / 3;
-
-        clookup[0] = block.cl0;
-        clookup[1] = block.cl1;
-        clookup[2] = block.cl2;
-        clookup[3] = block.cl3;
-        clookup[4] = block.cl4;
-        clookup[5] = block.cl5;
-        clookup[6] = block.cl6;
-        clookup[7] = block.cl7;
-        clookup[8] = block.cl8;
-        clookup[9] = block.cl9;
-        clookup[10] = block.cl10;
-        clookup[11] = block.cl11;
-        clookup[12] = block.cl12;
-        clookup[13] = block.cl13;
-        clookup[14] = block.cl14;
-        clookup[15] = block.cl15;
-
-        for (j = 0; j < 16; j++) {
-            x = ((i / 16) % (width / 4)) * 4 + 3 - (j % 4);
-            y = ((i / 16) / (width / 4)) * 4 + (j / 4);
-            index = (y * width + x) * 4;
-            *(output + index + 0) = c[clookup[j]][0];
-            *(output + index + 1) = c[clookup[j]][1];
-            *(output + index + 2) = c[clookup[j]][2];
-            *(output + index + 3) = a[alookup[j]];
+    for (y = 0; y < height; y += 4) {
+        for (x = 0; x < width; x += 4) {
+            if (x + 4 <= width && y + 4 <= height)
+                dxt_decode_block(input + 8, input, output + (y * width + x) * 4, width * 4);
+            else
+                dxt_decode_partial_block(input + 8, input, output + (y * width + x) * 4, width * 4, MIN(4, width - x), MIN(4, height - y));
+            input += 16;
         }
     }
 
@@ -241,13 +273,82 @@ int dxt52img(unsigned char *input, unsigned char *output, int width, int height)
 }
 
 
+int argb44442img(unsigned char *input, unsigned char *output, int num_pixels) {
+    /* Convert ARGB4444 data into a PNG image array. */
+
+    uint16_t pixel;
+    int i;
+
+    for (i = 0; i < num_pixels; i++) {
+        pixel = input[0] | (input[1] << 8);
+
+        output[0] = ((pixel >> 8) & 0xf) * 17;
+        output[1] = ((pixel >> 4) & 0xf) * 17;
+        output[2] = (pixel & 0xf) * 17;
+        output[3] = (pixel >> 12) * 17;
+
+        input += 2;
+        output += 4;
+    }
+
+    return 0;
+}
+
+
+int argb15552img(unsigned char *input, unsigned char *output, int num_pixels) {
+    /* Convert ARGB1555 data into a PNG image array. */
+
+    uint16_t pixel;
+    int i;
+
+    for (i = 0; i < num_pixels; i++) {
+        pixel = input[0] | (input[1] << 8);
+
+        output[0] = dxt_expand5[(pixel >> 10) & 0x1f];
+        output[1] = dxt_expand5[(pixel >> 5) & 0x1f];
+        output[2] = dxt_expand5[pixel & 0x1f];
+        output[3] = (pixel & 0x8000) ? 255 : 0;
+
+        input += 2;
+        output += 4;
+    }
+
+    return 0;
+}
+
+
+int ai882img(unsigned char *input, unsigned char *output, int num_pixels) {
+    /* Convert AI88 data into a PNG image array. */
+
+    int i;
+
+    for (i = 0; i < num_pixels; i++) {
+        output[0] = input[0];
+        output[1] = input[0];
+        output[2] = input[0];
+        output[3] = input[1];
+
+        input += 2;
+        output += 4;
+    }
+
+    return 0;
+}
+
+
 int paa2img(char *source, char *target) {
     /*
      * Converts PAA to PNG.
      *
+     * Only a single MipMap is decoded: the one given by --mip, the largest
+     * one that fits into --max-size or the full resolution one otherwise.
+     * It is located through the offsets table, so the levels before it
+     * are never read.
+     *
      * Returns 0 on success and a positive integer on failure.
      */
 
+    extern struct arguments args;
     FILE *f;
     char taggsig[5];
     char taggname[5];
@@ -255,13 +356,17 @@ int paa2img(char *source, char *target) {
     unsigned char *imgdata;
     unsigned char *outputdata;
     uint32_t tagglen;
-    uint32_t mipmap;
+    uint32_t offsets[16];
     uint32_t datalen;
     uint16_t paatype;
     uint16_t width;
     uint16_t height;
     int compression;
     int imgdatalen;
+    int wanted;
+    int maxsize;
+    int mip;
+    int i;
     lzo_uint out_len;
 
     f = fopen(source, "rb");
@@ -289,11 +394,45 @@ int paa2img(char *source, char *target) {
             continue;
         }
 
-        fread(&mipmap, 4, 1, f);
+        memset(offsets, 0, sizeof(offsets));
+        fread(offsets, 4, (tagglen / 4 < 16) ? tagglen / 4 : 16, f);
         break;
     }
 
-    fseek(f, mipmap, SEEK_SET);
+    wanted = args.mip ? atoi(args.mip) : -1;
+    maxsize = args.maxsize ? atoi(args.maxsize) : 0;
+
+    // Walk the MipMap headers until we find the requested one
+    mip = -1;
+    for (i = 0; i < 16 && offsets[i] != 0; i++) {
+        fseek(f, offsets[i], SEEK_SET);
+        fread(&width, sizeof(width), 1, f);
+        fread(&height, sizeof(height), 1, f);
+        if (width == 0 || height == 0)
+            break;
+
+        mip = i;
+        if (wanted >= 0) {
+            if (i == wanted)
+                break;
+        } else if (maxsize <= 0 || (width % 32768 <= maxsize && height <= maxsize)) {
+            break;
+        }
+    }
+
+    if (mip < 0) {
+        errorf("Failed to find MIPMAP.\n");
+        fclose(f);
+        return 2;
+    }
+
+    if (wanted >= 0 && mip != wanted) {
+        errorf("MIPMAP %i requested, but the PAA only has %i.\n", wanted, mip + 1);
+        fclose(f);
+        return 2;
+    }
+
+    fseek(f, offsets[mip], SEEK_SET);
     fread(&width, sizeof(width), 1, f);
     fread(&height, sizeof(height), 1, f);
     datalen = 0;
@@ -304,18 +443,18 @@ int paa2img(char *source, char *target) {
     fclose(f);
 
     compression = COMP_NONE;
-    if (width % 32768 != width && (paatype == DXT1 || paatype == DXT3 || paatype == DXT5)) {
+    if (width % 32768 != width && IS_DXT(paatype)) {
         width -= 32768;
         compression = COMP_LZO;
-    } else if (paatype == ARGB4444 || paatype == ARGB1555 || paatype == AI88) {
-        compression = COMP_LZSS;
     }
 
-    imgdatalen = width * height;
-    if (paatype == DXT1)
-        imgdatalen /= 2;
+    imgdatalen = mipmap_length(paatype, width, height);
     imgdata = safe_malloc(imgdatalen);
 
+    // The other formats are LZSS compressed, unless that wouldn't have saved anything
+    if (!IS_DXT(paatype) && datalen != imgdatalen)
+        compression = COMP_LZSS;
+
     if (compression == COMP_LZO) {
         out_len = imgdatalen;
         if (lzo_init() != LZO_E_OK) {
@@ -331,11 +470,19 @@ int paa2img(char *source, char *target) {
             return 3;
         }
     } else if (compression == COMP_LZSS) {
-        errorf("LZSS compression support is not implemented.\n");
-        free(imgdata);
-        free(compresseddata);
-        return 3;
+        if (lzss_decompress(compresseddata, datalen, imgdata, imgdatalen, true)) {
+            errorf("Failed to decompress LZSS data.\n");
+            free(imgdata);
+            free(compresseddata);
+            return 3;
+        }
     } else {
+        if (datalen < imgdatalen) {
+            errorf("Mipmap data is truncated.\n");
+            free(imgdata);
+            free(compresseddata);
+            return 3;
+        }
         memcpy(imgdata, compresseddata, imgdatalen);
     }
 
@@ -366,20 +513,14 @@ int paa2img(char *source, char *target) {
             }
             break;
         case ARGB4444:
-            errorf("ARGB4444 support is not implemented.\n");
-            free(outputdata);
-            free(imgdata);
-            return 4;
+            argb44442img(imgdata, outputdata, width * height);
+            break;
         case ARGB1555:
-            errorf("ARGB1555 support is not implemented.\n");
-            free(outputdata);
-            free(imgdata);
-            return 4;
+            argb15552img(imgdata, outputdata, width * height);
+            break;
         case AI88:
-            errorf("GRAY / AI88 support is not implemented.\n");
-            free(outputdata);
-            free(imgdata);
-            return 4;
+            ai882img(imgdata, outputdata, width * height);
+            break;
         default:
             errorf("Unrecognized PAA type.\n");
             free(outputdata);
@@ -403,10 +544,30 @@ int paa2img(char *source, char *target) {
 
 int cmd_paa2img() {
     extern struct arguments args;
+    char *extensions[] = { "paa", "pac", NULL };
+
+    char *endptr;
 
     if (args.num_positionals != 3)
         return 128;
 
+    // strtol skips leading whitespace and signs, so check the first character too
+    if (args.mip && (!isdigit(args.mip[0]) || strtol(args.mip, &endptr, 10) > 15 || *endptr != 0)) {
+        errorf("Invalid MIPMAP index \"%s\".\n", args.mip);
+        return 1;
+    }
+
+    if (args.maxsize && (!isdigit(args.maxsize[0]) || strtol(args.maxsize, &endptr, 10) <= 0 || *endptr != 0)) {
+        errorf("Invalid maximum size \"%s\".\n", args.maxsize);
+        return 1;
+    }
+
+    if (args.batch) {
+        // stb_image_write builds its CRC table on first use, do that before any threads exist
+        stbiw__crc32(NULL, 0);
+        return convert_directory(args.positionals[1], args.positionals[2], extensions, "png", args.force, paa2img);
+    }
+
     // check if target already exists
     if (access(args.positionals[2], F_OK) != -1 && !args.force) {
         errorf("File %s already exists and --force was not set.\n", args.positionals[2]);
@@ -19,6 +19,9 @@
 #pragma once
 
 
+#include <stdint.h>
+
+
 #define DXT1     0xFF01
 #define DXT3     0xFF03
 #define DXT5     0xFF05
@@ -30,11 +33,29 @@
 #define COMP_LZSS 1
 #define COMP_LZO  2
 
+#define IS_DXT(paatype) ((paatype) == DXT1 || (paatype) == DXT3 || (paatype) == DXT5)
+
+
+int mipmap_length(uint16_t paatype, int width, int height);
+
+void dxt_color_palette(unsigned char *block, unsigned char palette[4][4], unsigned char alpha);
+
+void dxt_alpha_palette(unsigned char *block, unsigned char palette[8]);
+
+void dxt_decode_block(unsigned char *color_block, unsigned char *alpha_block, unsigned char *output, int stride);
+
+void dxt_decode_partial_block(unsigned char *color_block, unsigned char *alpha_block, unsigned char *output, int stride, int width, int height);
 
 int dxt12img(unsigned char *input, unsigned char *output, int width, int height);
 
 int dxt52img(unsigned char *input, unsigned char *output, int width, int height);
 
+int argb44442img(unsigned char *input, unsigned char *output, int num_pixels);
+
+int argb15552img(unsigned char *input, unsigned char *output, int num_pixels);
+
+int ai882img(unsigned char *input, unsigned char *output, int num_pixels);
+
 int paa2img(char *source, char *target);
 
 int cmd_paa2img();
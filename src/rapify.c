@@ -288,72 +288,21 @@ void rapify_class(struct class *class, FILE *f_target) {
     }
 }
 
-int rapify_file(char *source, char *target) {
+int parse_config(char *source, struct class **result) {
     /*
-     * Resolves macros/includes and rapifies the given file. If source and
-     * target are identical, the target is overwritten.
+     * Resolves macros/includes in the given file and parses it into a
+     * class tree, which is stored in result.
      *
      * Returns 0 on success and a positive integer on failure.
      */
 
     extern char *current_target;
     FILE *f_temp;
-    FILE *f_target;
     int i;
-    int datasize;
     int success;
-    char buffer[4096];
-    uint32_t enum_offset = 0;
     struct constants *constants;
     struct lineref *lineref;
 
-    current_target = source;
-
-    // Check if the file is already rapified
-    f_temp = fopen(source, "rb");
-    if (!f_temp) {
-        errorf("Failed to open %s.\n", source);
-        return 1;
-    }
-
-    fread(buffer, 4, 1, f_temp);
-    if (strncmp(buffer, "\0raP", 4) == 0) {
-        if ((strcmp(source, target)) == 0) {
-            fclose(f_temp);
-            return 0;
-        }
-
-        if (strcmp(target, "-") == 0) {
-            f_target = stdout;
-        } else {
-            f_target = fopen(target, "wb");
-            if (!f_target) {
-                errorf("Failed to open %s.\n", target);
-                fclose(f_temp);
-                return 2;
-            }
-        }
-
-        fseek(f_temp, 0, SEEK_END);
-        datasize = ftell(f_temp);
-
-        fseek(f_temp, 0, SEEK_SET);
-        for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_temp);
-            fwrite(buffer, sizeof(buffer), 1, f_target);
-        }
-        fread(buffer, datasize - i, 1, f_temp);
-        fwrite(buffer, datasize - i, 1, f_target);
-
-        fclose(f_temp);
-        if (strcmp(target, "-") != 0)
-            fclose(f_target);
-
-        return 0;
-    } else {
-        fclose(f_temp);
-    }
-
 #ifdef _WIN32
     char temp_name[2048];
     if (!GetTempFileName(".", "amk", 0, temp_name)) {
@@ -400,6 +349,8 @@ int rapify_file(char *source, char *target) {
 
 #if 0
     FILE *f_dump;
+    char buffer[4096];
+    int datasize;
 
     char dump_name[2048];
     sprintf(dump_name, "armake_preprocessed_%u.dump", (unsigned)time(NULL));
@@ -422,26 +373,134 @@ int rapify_file(char *source, char *target) {
 #endif
 
     fseek(f_temp, 0, SEEK_SET);
-    struct class *result;
-    result = parse_file(f_temp, lineref);
+    *result = parse_file(f_temp, lineref);
+
+    fclose(f_temp);
 
-    if (result == NULL) {
+#ifdef _WIN32
+    DeleteFile(temp_name);
+#endif
+
+    constants_free(constants);
+
+    for (i = 0; i < lineref->num_files; i++)
+        free(lineref->file_names[i]);
+    free(lineref->file_names);
+    free(lineref->file_index);
+    free(lineref->line_number);
+    free(lineref);
+
+    if (*result == NULL) {
         errorf("Failed to parse config.\n");
         return 1;
     }
 
+    return 0;
+}
+
+
+void write_rapified(struct class *result, FILE *f_target) {
+    /*
+     * Writes the rapified form of the given class tree, including the
+     * header, to the start of f_target.
+     */
+
+    uint32_t enum_offset = 0;
+
+    fwrite("\0raP", 4, 1, f_target);
+    fwrite("\0\0\0\0\x08\0\0\0", 8, 1, f_target);
+    fwrite(&enum_offset, 4, 1, f_target); // this is replaced later
+
+    rapify_class(result, f_target);
+
+    enum_offset = ftell(f_target);
+    fwrite("\0\0\0\0", 4, 1, f_target); // fuck enums
+    fseek(f_target, 12, SEEK_SET);
+    fwrite(&enum_offset, 4, 1, f_target);
+}
+
+
+int rapify_file(char *source, char *target) {
+    /*
+     * Resolves macros/includes and rapifies the given file. If source and
+     * target are identical, the target is overwritten.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    extern char *current_target;
+    FILE *f_temp;
+    FILE *f_target;
+    int i;
+    int datasize;
+    int success;
+    char buffer[4096];
+    struct class *result;
+
+    current_target = source;
+
+    // Check if the file is already rapified
+    f_temp = fopen(source, "rb");
+    if (!f_temp) {
+        errorf("Failed to open %s.\n", source);
+        return 1;
+    }
+
+    fread(buffer, 4, 1, f_temp);
+    if (strncmp(buffer, "\0raP", 4) == 0) {
+        if ((strcmp(source, target)) == 0) {
+            fclose(f_temp);
+            return 0;
+        }
+
+        if (strcmp(target, "-") == 0) {
+            f_target = stdout;
+        } else {
+            f_target = fopen(target, "wb");
+            if (!f_target) {
+                errorf("Failed to open %s.\n", target);
+                fclose(f_temp);
+                return 2;
+            }
+        }
+
+        fseek(f_temp, 0, SEEK_END);
+        datasize = ftell(f_temp);
+
+        fseek(f_temp, 0, SEEK_SET);
+        for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
+            fread(buffer, sizeof(buffer), 1, f_temp);
+            fwrite(buffer, sizeof(buffer), 1, f_target);
+        }
+        fread(buffer, datasize - i, 1, f_temp);
+        fwrite(buffer, datasize - i, 1, f_target);
+
+        fclose(f_temp);
+        if (strcmp(target, "-") != 0)
+            fclose(f_target);
+
+        return 0;
+    } else {
+        fclose(f_temp);
+    }
+
+    success = parse_config(source, &result);
+    if (success)
+        return success;
+
 #ifdef _WIN32
-    char temp_name2[2048];
+    char temp_name[2048];
 #endif
 
     // Rapify file
     if (strcmp(target, "-") == 0) {
 #ifdef _WIN32
-        if (!GetTempFileName(".", "amk", 0, temp_name2)) {
+        if (!GetTempFileName(".", "amk", 0, temp_name)) {
             errorf("Failed to get temp file name (system error %i).\n", GetLastError());
+            free_class(result);
             return 1;
         }
-        f_target = fopen(temp_name2, "wb+");
+        f_target = fopen(temp_name, "wb+");
 #else
         f_target = tmpfile();
 #endif
@@ -449,28 +508,21 @@ int rapify_file(char *source, char *target) {
         if (!f_target) {
             errorf("Failed to open temp file.\n");
 #ifdef _WIN32
-            DeleteFile(temp_name2);
+            DeleteFile(temp_name);
 #endif
+            free_class(result);
             return 1;
         }
     } else {
         f_target = fopen(target, "wb+");
         if (!f_target) {
             errorf("Failed to open %s.\n", target);
-            fclose(f_temp);
+            free_class(result);
             return 2;
         }
     }
-    fwrite("\0raP", 4, 1, f_target);
-    fwrite("\0\0\0\0\x08\0\0\0", 8, 1, f_target);
-    fwrite(&enum_offset, 4, 1, f_target); // this is replaced later
 
-    rapify_class(result, f_target);
-
-    enum_offset = ftell(f_target);
-    fwrite("\0\0\0\0", 4, 1, f_target); // fuck enums
-    fseek(f_target, 12, SEEK_SET);
-    fwrite(&enum_offset, 4, 1, f_target);
+    write_rapified(result, f_target);
 
     if (strcmp(target, "-") == 0) {
         fseek(f_target, 0, SEEK_END);
@@ -485,25 +537,94 @@ int rapify_file(char *source, char *target) {
         fwrite(buffer, datasize - i, 1, stdout);
     }
 
-    fclose(f_temp);
     fclose(f_target);
 
 #ifdef _WIN32
-    DeleteFile(temp_name);
     if (strcmp(target, "-") == 0)
-        DeleteFile(temp_name2);
+        DeleteFile(temp_name);
 #endif
 
-    constants_free(constants);
+    free_class(result);
 
-    for (i = 0; i < lineref->num_files; i++)
-        free(lineref->file_names[i]);
-    free(lineref->file_names);
-    free(lineref->file_index);
-    free(lineref->line_number);
-    free(lineref);
+    return 0;
+}
 
-    free_class(result);
+
+int write_rapified_temp(struct class *result, FILE **f_target) {
+    /*
+     * Writes the rapified form of the given class tree into an anonymous
+     * temporary file. The returned handle is positioned at the start of the
+     * rapified data and has to be closed by the caller.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+#ifdef _WIN32
+    // D: delete the file once the handle is closed
+    char temp_name[2048];
+    if (!GetTempFileName(".", "amk", 0, temp_name)) {
+        errorf("Failed to get temp file name (system error %i).\n", GetLastError());
+        return 1;
+    }
+    *f_target = fopen(temp_name, "wb+D");
+#else
+    *f_target = tmpfile();
+#endif
+
+    if (!*f_target) {
+        errorf("Failed to open temp file.\n");
+#ifdef _WIN32
+        DeleteFile(temp_name);
+#endif
+        return 1;
+    }
+
+    write_rapified(result, *f_target);
+    fseek(*f_target, 0, SEEK_SET);
 
     return 0;
 }
+
+
+int rapify_temp(char *source, FILE **f_target) {
+    /*
+     * Rapifies the given file into an anonymous temporary file, so callers
+     * that only read values from a config don't have to write anything next
+     * to the source. The returned handle is positioned at the start of the
+     * rapified data and has to be closed by the caller. Already rapified
+     * sources are opened directly.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    extern char *current_target;
+    char buffer[4];
+    int success;
+    struct class *result;
+
+    current_target = source;
+
+    *f_target = fopen(source, "rb");
+    if (!*f_target) {
+        errorf("Failed to open %s.\n", source);
+        return 1;
+    }
+
+    if (fread(buffer, 4, 1, *f_target) == 1 && strncmp(buffer, "\0raP", 4) == 0) {
+        fseek(*f_target, 0, SEEK_SET);
+        return 0;
+    }
+
+    fclose(*f_target);
+    *f_target = NULL;
+
+    success = parse_config(source, &result);
+    if (success)
+        return success;
+
+    success = write_rapified_temp(result, f_target);
+
+    free_class(result);
+
+    return success;
+}
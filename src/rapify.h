@@ -97,4 +97,12 @@ void rapify_variable(struct variable *var, FILE *f_target);
 
 void rapify_class(struct class *class, FILE *f_target);
 
+int parse_config(char *source, struct class **result);
+
+void write_rapified(struct class *result, FILE *f_target);
+
 int rapify_file(char *source, char *target);
+
+int write_rapified_temp(struct class *result, FILE **f_target);
+
+int rapify_temp(char *source, FILE **f_target);
@@ -24,11 +24,13 @@
 #include <unistd.h>
 #include <openssl/bn.h>
 
-#include "sha1.h"
+#include "hash.h"
 #include "args.h"
 #include "filesystem.h"
 #include "utils.h"
 #include "keygen.h"
+#include "unpack.h"
+#include "threads.h"
 #include "sign.h"
 
 
@@ -61,233 +63,440 @@ int name_hash_sort(const void *av, const void *bv) {
     return 0;
 }
 
-int sign_pbo(char *path_pbo, char *path_privatekey, char *path_signature) {
-    SHA1Context sha;
-    BN_CTX *bignum_context;
-    BIGNUM *hash1_padded;
-    BIGNUM *hash2_padded;
-    BIGNUM *hash3_padded;
-    BIGNUM *sig1;
-    BIGNUM *sig2;
-    BIGNUM *sig3;
-    BIGNUM *exp;
-    BIGNUM *modulus;
-    bool nothing;
-    long i;
-    long fp_header;
-    long fp_body;
-    long fp_tmp;
-    uint32_t temp;
-    uint32_t keylength;
-    uint32_t exponent_le;
-    char **names;
-    char buffer[4096];
-    char prefix[512];
-    char keyname[512];
-    unsigned char hash1[20];
-    unsigned char hash2[20];
-    unsigned char hash3[20];
-    unsigned char filehash[20];
-    unsigned char namehash[20];
-    FILE *f_pbo;
-    FILE *f_privatekey;
-    FILE *f_signature;
-    int j;
+BIGNUM *read_key_component(FILE *f, int size) {
+    /*
+     * Reads a little endian number of the given size (in bytes) from a key
+     * file.
+     *
+     * Returns the number, NULL on failure.
+     */
 
-    f_pbo = fopen(path_pbo, "rb");
-    if (!f_pbo)
+    unsigned char buffer[4096];
+
+    if (size > sizeof(buffer) || fread(buffer, size, 1, f) != 1)
+        return NULL;
+
+    reverse_endianness(buffer, size);
+
+    return BN_bin2bn(buffer, size, NULL);
+}
+
+
+int read_private_key(char *path, struct private_key *key) {
+    /*
+     * Reads a .biprivatekey (a PRIVATEKEYBLOB prefixed by the key name):
+     * the modulus, the CRT components p, q, dmp1, dmq1 and iqmp, and the
+     * private exponent d. Montgomery contexts for p and q are set up so
+     * they can be reused for every signature.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f;
+    BN_CTX *ctx;
+    bool failed;
+
+    memset(key, 0, sizeof(struct private_key));
+
+    f = fopen(path, "rb");
+    if (!f)
         return 1;
 
-    // get prefix
-    if (fgetc(f_pbo) == 0) {
-        fseek(f_pbo, 20, SEEK_CUR);
-        do {
-            fp_tmp = ftell(f_pbo);
-            fread(buffer, sizeof(buffer), 1, f_pbo);
-            if (strcmp(buffer, "prefix") == 0)
-                strncpy(prefix, buffer + strlen(buffer) + 1, sizeof(prefix));
-            fseek(f_pbo, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-        } while (strlen(buffer) > 0);
-    } else {
-        fseek(f_pbo, 0, SEEK_SET); // no header extensions
+    fread(key->name, sizeof(key->name), 1, f);
+    key->name[sizeof(key->name) - 1] = 0;
+    fseek(f, strlen(key->name) + 1, SEEK_SET);
+    fseek(f, 16, SEEK_CUR);
+    fread(&key->length, sizeof(key->length), 1, f);
+    fread(&key->exponent, sizeof(key->exponent), 1, f);
+
+    if (key->length == 0 || key->length % 16 != 0 || key->length / 8 > 4096) {
+        fclose(f);
+        return 2;
     }
 
-    if (prefix[strlen(prefix) - 1] != '\\')
-        strcat(prefix, "\\");
+    key->modulus = read_key_component(f, key->length / 8);
+    key->p = read_key_component(f, key->length / 16);
+    key->q = read_key_component(f, key->length / 16);
+    key->dmp1 = read_key_component(f, key->length / 16);
+    key->dmq1 = read_key_component(f, key->length / 16);
+    key->iqmp = read_key_component(f, key->length / 16);
+    key->d = read_key_component(f, key->length / 8);
 
-    fp_header = ftell(f_pbo);
+    fclose(f);
 
-    // get all file names for name hash
-    names = safe_malloc(32 * sizeof(char *));
-    i = 0;
-    do {
-        fp_tmp = ftell(f_pbo);
-        fread(buffer, sizeof(buffer), 1, f_pbo);
-        fseek(f_pbo, fp_tmp + strlen(buffer) + 17, SEEK_SET);
-        fread(&temp, sizeof(temp), 1, f_pbo);
-        if (temp == 0)
-            continue;
+    if (!key->modulus || !key->p || !key->q || !key->dmp1 || !key->dmq1 || !key->iqmp || !key->d) {
+        free_private_key(key);
+        return 3;
+    }
+
+    ctx = BN_CTX_new();
+    key->mont_p = BN_MONT_CTX_new();
+    key->mont_q = BN_MONT_CTX_new();
+    failed = !ctx || !key->mont_p || !key->mont_q ||
+        !BN_MONT_CTX_set(key->mont_p, key->p, ctx) ||
+        !BN_MONT_CTX_set(key->mont_q, key->q, ctx);
+    BN_CTX_free(ctx);
+
+    if (failed) {
+        free_private_key(key);
+        return 4;
+    }
+
+    return 0;
+}
+
+
+void free_private_key(struct private_key *key) {
+    BN_free(key->modulus);
+    BN_free(key->p);
+    BN_free(key->q);
+    BN_free(key->dmp1);
+    BN_free(key->dmq1);
+    BN_free(key->iqmp);
+    BN_clear_free(key->d);
+    BN_MONT_CTX_free(key->mont_p);
+    BN_MONT_CTX_free(key->mont_q);
+    memset(key, 0, sizeof(struct private_key));
+}
+
+
+int rsa_sign(BIGNUM *signature, BIGNUM *hash, struct private_key *key, BN_CTX *ctx) {
+    /*
+     * Computes hash^d mod n through the CRT: two half size exponentiations
+     * modulo p and q, recombined with Garner's formula, which is several
+     * times faster than the full size one. The result is checked against
+     * the public exponent, falling back to the plain exponentiation should
+     * the key's CRT components not match its private exponent, so the
+     * signature is always the same as without the CRT.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    BIGNUM *m1;
+    BIGNUM *m2;
+    BIGNUM *h;
+    BIGNUM *exponent;
+    BIGNUM *check;
+    int success;
 
-        if (i > 0 && i % 32 == 0)
-            names = safe_realloc(names, (i + 32) * sizeof(char *));
+    BN_CTX_start(ctx);
+    m1 = BN_CTX_get(ctx);
+    m2 = BN_CTX_get(ctx);
+    h = BN_CTX_get(ctx);
+    exponent = BN_CTX_get(ctx);
+    check = BN_CTX_get(ctx);
 
-        names[i] = strdup(buffer);
-        lower_case(names[i]);
-        i++;
-    } while (strlen(buffer) > 0);
-    fp_body = ftell(f_pbo);
+    success = 1;
+    if (!check)
+        goto cleanup;
 
-    // sort file names
-    qsort(names, i, sizeof(char *), name_hash_sort);
+    // m1 = hash^dmp1 mod p, m2 = hash^dmq1 mod q
+    if (!BN_mod(h, hash, key->p, ctx) ||
+            !BN_mod_exp_mont(m1, h, key->dmp1, key->p, ctx, key->mont_p) ||
+            !BN_mod(h, hash, key->q, ctx) ||
+            !BN_mod_exp_mont(m2, h, key->dmq1, key->q, ctx, key->mont_q))
+        goto cleanup;
 
-    // calculate name hash
-    SHA1Reset(&sha);
-    for (j = 0; j < i; j++) {
-        SHA1Input(&sha, (unsigned char *)names[j], strlen(names[j]));
-        free(names[j]);
+    // signature = m2 + q * (iqmp * (m1 - m2) mod p)
+    if (!BN_mod_sub(h, m1, m2, key->p, ctx) ||
+            !BN_mod_mul(h, h, key->iqmp, key->p, ctx) ||
+            !BN_mul(h, h, key->q, ctx) ||
+            !BN_add(signature, h, m2))
+        goto cleanup;
+
+    if (!BN_set_word(exponent, key->exponent) ||
+            !BN_mod_exp(check, signature, exponent, key->modulus, ctx))
+        goto cleanup;
+
+    if (BN_cmp(check, hash) != 0 && !BN_mod_exp(signature, hash, key->d, key->modulus, ctx))
+        goto cleanup;
+
+    success = 0;
+
+cleanup:
+    BN_CTX_end(ctx);
+
+    return success;
+}
+
+
+int name_hash(char **names, int num_names, unsigned char hash[20]) {
+    /*
+     * Computes the name hash over the given (lower case) names of all
+     * non-empty files in a PBO. The names are sorted in place.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct sha1 sha;
+    int i;
+
+    qsort(names, num_names, sizeof(char *), name_hash_sort);
+
+    sha1_init(&sha);
+    for (i = 0; i < num_names; i++)
+        sha1_update(&sha, (unsigned char *)names[i], strlen(names[i]));
+
+    return sha1_final(&sha, hash);
+}
+
+
+int read_zstring(FILE *f, char *buffer, size_t buffsize) {
+    /*
+     * Reads a zero-terminated string into buffer.
+     *
+     * Returns 0 on success, 1 on EOF and 2 if the string doesn't fit.
+     */
+
+    size_t i;
+    int c;
+
+    for (i = 0; i < buffsize; i++) {
+        c = getc(f);
+        if (c == EOF)
+            return 1;
+
+        buffer[i] = c;
+        if (c == 0)
+            return 0;
     }
-    free(names);
 
-    if (!SHA1Result(&sha)) {
-        fclose(f_pbo);
-        return 1;
+    buffer[buffsize - 1] = 0;
+    return 2;
+}
+
+
+bool is_hashed_file(char *name) {
+    /* Checks whether a (lower case) file is part of the file hash. */
+
+    char *extensions[] = { ".paa", ".jpg", ".p3d", ".tga", ".rvmat", ".lip", ".ogg",
+        ".wss", ".png", ".rtm", ".pac", ".fxy", ".wrp", NULL };
+    char *extension;
+    int i;
+
+    extension = strrchr(name, '.');
+    if (extension == NULL)
+        return true;
+
+    for (i = 0; extensions[i] != NULL; i++) {
+        if (strcmp(extension, extensions[i]) == 0)
+            return false;
     }
 
-    for (i = 0; i < 5; i++)
-        reverse_endianness(&sha.Message_Digest[i], sizeof(sha.Message_Digest[i]));
+    return true;
+}
 
-    memcpy(namehash, &sha.Message_Digest[0], 20);
 
-    // calculate file hash
-    SHA1Reset(&sha);
-    nothing = true;
+int hash_pbo(char *path_pbo, char *prefix, unsigned char namehash[20], unsigned char filehash[20], unsigned char checksum[20]) {
+    /*
+     * Computes the hashes a signature is made of in a single sequential
+     * pass over the PBO: the header table is parsed into memory, which is
+     * enough for the prefix and the name hash, then the data section is
+     * streamed for the file hash and followed by the PBO's own SHA1
+     * checksum. prefix has to hold 512 bytes.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct sha1 sha;
+    FILE *f_pbo;
+    struct header *headers;
+    char **names;
+    char key[512];
+    char value[512];
+    unsigned char *buffer;
+    uint32_t fields[5];
+    uint32_t remaining;
+    size_t chunk;
+    bool nothing;
+    int num_files;
+    int num_names;
+    int success;
+    int i;
+
+    f_pbo = fopen(path_pbo, "rb");
+    if (!f_pbo)
+        return 1;
+
+    headers = NULL;
+    names = NULL;
+    buffer = NULL;
+    sha.evp = NULL;
+    num_files = 0;
+    num_names = 0;
+    prefix[0] = 0;
+    success = 2;
+
+    // header extensions, in the header of an entry with an empty name
+    if (getc(f_pbo) == 0) {
+        if (fread(fields, sizeof(fields), 1, f_pbo) != 1)
+            goto cleanup;
+
+        // scanned string by string until an empty one, the one after "prefix" is its value
+        key[0] = 0;
+        while (true) {
+            if (read_zstring(f_pbo, value, sizeof(value)) == 1)
+                goto cleanup;
+            if (strcmp(key, "prefix") == 0)
+                strcpy(prefix, value);
+            if (strlen(value) == 0)
+                break;
+            strcpy(key, value);
+        }
+    } else {
+        fseek(f_pbo, 0, SEEK_SET);
+    }
+
+    // header table
     while (true) {
-        fseek(f_pbo, fp_header, SEEK_SET);
-        fread(buffer, sizeof(buffer), 1, f_pbo);
-        lower_case(buffer);
-        fseek(f_pbo, fp_header + strlen(buffer) + 17, SEEK_SET);
-        fread(&temp, sizeof(temp), 1, f_pbo);
+        if (num_files % 32 == 0)
+            headers = (struct header *)safe_realloc(headers, sizeof(struct header) * (num_files + 32));
 
-        fp_header = ftell(f_pbo);
+        if (read_zstring(f_pbo, headers[num_files].name, sizeof(headers[num_files].name)) ||
+                fread(fields, sizeof(fields), 1, f_pbo) != 1)
+            goto cleanup;
 
-        if (strlen(buffer) == 0)
+        if (strlen(headers[num_files].name) == 0)
             break;
 
-        if (temp == 0)
+        lower_case(headers[num_files].name);
+        headers[num_files].packing_method = fields[0];
+        headers[num_files].original_size = fields[1];
+        headers[num_files].data_size = fields[4];
+        num_files++;
+    }
+
+    // name hash over the sorted names of all non-empty files
+    names = (char **)safe_malloc(sizeof(char *) * (num_files + 1));
+    for (i = 0; i < num_files; i++) {
+        if (headers[i].data_size > 0)
+            names[num_names++] = headers[i].name;
+    }
+
+    if (name_hash(names, num_names, namehash))
+        goto cleanup;
+
+    // file hash, streaming the data section
+    buffer = (unsigned char *)safe_malloc(SIGN_BUFFER_SIZE);
+    sha1_init(&sha);
+    nothing = true;
+
+    for (i = 0; i < num_files; i++) {
+        if (headers[i].data_size == 0)
             continue;
 
-        if (strchr(buffer, '.') != NULL && (
-                strcmp(strrchr(buffer, '.'), ".paa") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".jpg") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".p3d") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".tga") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".rvmat") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".lip") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".ogg") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".wss") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".png") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".rtm") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".pac") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".fxy") == 0 ||
-                strcmp(strrchr(buffer, '.'), ".wrp") == 0)) {
-            fp_body += temp;
+        if (!is_hashed_file(headers[i].name)) {
+            if (fseek(f_pbo, headers[i].data_size, SEEK_CUR))
+                goto cleanup;
             continue;
         }
 
         nothing = false;
 
-        fseek(f_pbo, fp_body, SEEK_SET);
-
-        for (i = 0; temp - i >= sizeof(buffer); i += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_pbo);
-            SHA1Input(&sha, (unsigned char *)buffer, sizeof(buffer));
+        for (remaining = headers[i].data_size; remaining > 0; remaining -= chunk) {
+            chunk = MIN(remaining, SIGN_BUFFER_SIZE);
+            if (fread(buffer, chunk, 1, f_pbo) != 1)
+                goto cleanup;
+            sha1_update(&sha, buffer, chunk);
         }
-        fread(buffer, temp - i, 1, f_pbo);
-        SHA1Input(&sha, (unsigned char *)buffer, temp - i);
-
-        fp_body += temp;
     }
 
     if (nothing)
-        SHA1Input(&sha, (unsigned char *)"nothing", strlen("nothing"));
+        sha1_update(&sha, (unsigned char *)"nothing", strlen("nothing"));
 
-    fseek(f_pbo, 0, SEEK_END);
+    if (sha1_final(&sha, filehash))
+        goto cleanup;
 
-    if (!SHA1Result(&sha)) {
-        fclose(f_pbo);
-        return 1;
-    }
+    // the PBO's checksum directly follows the data, after a zero byte
+    if (getc(f_pbo) != 0 || fread(checksum, 20, 1, f_pbo) != 1)
+        goto cleanup;
 
-    for (i = 0; i < 5; i++)
-        reverse_endianness(&sha.Message_Digest[i], sizeof(sha.Message_Digest[i]));
+    success = 0;
 
-    memcpy(filehash, &sha.Message_Digest[0], 20);
+cleanup:
+    sha1_free(&sha);
+    fclose(f_pbo);
+    free(headers);
+    free(names);
+    free(buffer);
 
-    // get hash 1
-    fseek(f_pbo, -20, SEEK_END);
-    fread(hash1, 20, 1, f_pbo);
+    return success;
+}
 
-    // calculate hash 2
-    SHA1Reset(&sha);
-    SHA1Input(&sha, hash1, 20);
-    SHA1Input(&sha, namehash, 20);
-    if (strlen(prefix) > 1)
-        SHA1Input(&sha, (unsigned char *)prefix, strlen(prefix));
-
-    if (!SHA1Result(&sha)) {
-        fclose(f_pbo);
-        return 1;
-    }
 
-    for (i = 0; i < 5; i++)
-        reverse_endianness(&sha.Message_Digest[i], sizeof(sha.Message_Digest[i]));
+int signature_hashes(unsigned char checksum[20], unsigned char namehash[20], unsigned char filehash[20],
+        char *prefix, unsigned char hash2[20], unsigned char hash3[20]) {
+    /*
+     * Computes the second and third hash of a signature from the hashes of
+     * a PBO (see hash_pbo), the first one being the checksum itself.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
 
-    memcpy(hash2, &sha.Message_Digest[0], 20);
+    struct sha1 sha;
+    char full_prefix[513];
 
-    // calculate hash 3
-    SHA1Reset(&sha);
-    SHA1Input(&sha, filehash, 20);
-    SHA1Input(&sha, namehash, 20);
-    if (strlen(prefix) > 1)
-        SHA1Input(&sha, (unsigned char *)prefix, strlen(prefix));
-
-    if (!SHA1Result(&sha)) {
-        fclose(f_pbo);
-        return 1;
-    }
+    strncpy(full_prefix, prefix, 511);
+    full_prefix[511] = 0;
+    if (strlen(full_prefix) == 0 || full_prefix[strlen(full_prefix) - 1] != '\\')
+        strcat(full_prefix, "\\");
 
-    for (i = 0; i < 5; i++)
-        reverse_endianness(&sha.Message_Digest[i], sizeof(sha.Message_Digest[i]));
+    // calculate hash 2
+    sha1_init(&sha);
+    sha1_update(&sha, checksum, 20);
+    sha1_update(&sha, namehash, 20);
+    if (strlen(full_prefix) > 1)
+        sha1_update(&sha, (unsigned char *)full_prefix, strlen(full_prefix));
+
+    if (sha1_final(&sha, hash2))
+        return 1;
 
-    memcpy(hash3, &sha.Message_Digest[0], 20);
+    // calculate hash 3
+    sha1_init(&sha);
+    sha1_update(&sha, filehash, 20);
+    sha1_update(&sha, namehash, 20);
+    if (strlen(full_prefix) > 1)
+        sha1_update(&sha, (unsigned char *)full_prefix, strlen(full_prefix));
 
-    // read private key data
-    f_privatekey = fopen(path_privatekey, "rb");
-    if (!f_privatekey) {
-        fclose(f_pbo);
+    if (sha1_final(&sha, hash3))
         return 1;
-    }
 
-    fread(keyname, sizeof(keyname), 1, f_privatekey);
-    fseek(f_privatekey, strlen(keyname) + 1, SEEK_SET);
-    fseek(f_privatekey, 16, SEEK_CUR);
-    fread(&keylength, sizeof(keylength), 1, f_privatekey);
-    fread(&exponent_le, sizeof(exponent_le), 1, f_privatekey);
+    return 0;
+}
+
 
-    fread(buffer, keylength / 8, 1, f_privatekey);
-    reverse_endianness(buffer, keylength / 8);
-    modulus = BN_new();
-    BN_bin2bn((unsigned char *)buffer, keylength / 8, modulus);
+int sign_hashes(unsigned char checksum[20], unsigned char namehash[20], unsigned char filehash[20],
+        char *prefix, struct private_key *key, char *path_signature) {
+    /*
+     * Signs a PBO given its checksum, name hash, file hash and prefix (see
+     * hash_pbo) and writes the signature to path_signature. The key is only
+     * read from, so it can be shared between threads.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
 
-    fseek(f_privatekey, (keylength / 16) * 5, SEEK_CUR);
+    BN_CTX *bignum_context;
+    BIGNUM *hash1_padded;
+    BIGNUM *hash2_padded;
+    BIGNUM *hash3_padded;
+    BIGNUM *sig1;
+    BIGNUM *sig2;
+    BIGNUM *sig3;
+    bool failed;
+    uint32_t temp;
+    uint32_t keylength;
+    char buffer[4096];
+    unsigned char hash2[20];
+    unsigned char hash3[20];
+    FILE *f_signature;
+
+    if (signature_hashes(checksum, namehash, filehash, prefix, hash2, hash3))
+        return 1;
 
-    fread(buffer, keylength / 8, 1, f_privatekey);
-    reverse_endianness(buffer, keylength / 8);
-    exp = BN_new();
-    BN_bin2bn((unsigned char *)buffer, keylength / 8, exp);
+    keylength = key->length;
 
     // generate signature values
-    pad_hash(hash1, buffer, keylength / 8);
+    pad_hash(checksum, buffer, keylength / 8);
     hash1_padded = BN_new();
     BN_bin2bn((unsigned char *)buffer, keylength / 8, hash1_padded);
 
@@ -302,31 +511,35 @@ int sign_pbo(char *path_pbo, char *path_privatekey, char *path_signature) {
     bignum_context = BN_CTX_new();
 
     sig1 = BN_new();
-    BN_mod_exp(sig1, hash1_padded, exp, modulus, bignum_context);
-
     sig2 = BN_new();
-    BN_mod_exp(sig2, hash2_padded, exp, modulus, bignum_context);
-
     sig3 = BN_new();
-    BN_mod_exp(sig3, hash3_padded, exp, modulus, bignum_context);
+
+    failed = rsa_sign(sig1, hash1_padded, key, bignum_context) ||
+        rsa_sign(sig2, hash2_padded, key, bignum_context) ||
+        rsa_sign(sig3, hash3_padded, key, bignum_context);
 
     // write to file
-    f_signature = fopen(path_signature, "wb");
+    f_signature = failed ? NULL : fopen(path_signature, "wb");
     if (!f_signature) {
-        fclose(f_privatekey);
-        fclose(f_pbo);
+        BN_CTX_free(bignum_context);
+        BN_free(hash1_padded);
+        BN_free(hash2_padded);
+        BN_free(hash3_padded);
+        BN_free(sig1);
+        BN_free(sig2);
+        BN_free(sig3);
         return 1;
     }
 
-    fwrite(keyname, strlen(keyname) + 1, 1, f_signature); //max. 512 B
+    fwrite(key->name, strlen(key->name) + 1, 1, f_signature); //max. 512 B
     temp = keylength / 8 + 20;
     fwrite(&temp, sizeof(temp), 1, f_signature); //4 B
     fwrite("\x06\x02\x00\x00\x00\x24\x00\x00", 8, 1, f_signature); //8 B
     fwrite("RSA1", 4, 1, f_signature); //4 B
     fwrite(&keylength, sizeof(keylength), 1, f_signature); //4 B
-    fwrite(&exponent_le, sizeof(exponent_le), 1, f_signature); //4 B
+    fwrite(&key->exponent, sizeof(key->exponent), 1, f_signature); //4 B
 
-    custom_bn2lebinpad(modulus, (unsigned char *)buffer, keylength / 8);
+    custom_bn2lebinpad(key->modulus, (unsigned char *)buffer, keylength / 8);
     fwrite(buffer, keylength / 8, 1, f_signature); //128 B
 
     temp = keylength / 8;
@@ -352,31 +565,86 @@ int sign_pbo(char *path_pbo, char *path_privatekey, char *path_signature) {
 
     // clean up
     BN_CTX_free(bignum_context);
-    BN_free(exp);
-    BN_free(modulus);
     BN_free(hash1_padded);
     BN_free(hash2_padded);
     BN_free(hash3_padded);
     BN_free(sig1);
     BN_free(sig2);
     BN_free(sig3);
-    fclose(f_pbo);
-    fclose(f_privatekey);
     fclose(f_signature);
 
     return 0;
 }
 
+int sign_pbo(char *path_pbo, struct private_key *key, char *path_signature) {
+    char prefix[512];
+    unsigned char checksum[20];
+    unsigned char namehash[20];
+    unsigned char filehash[20];
+
+    if (hash_pbo(path_pbo, prefix, namehash, filehash, checksum))
+        return 1;
+
+    return sign_hashes(checksum, namehash, filehash, prefix, key, path_signature);
+}
+
+
+int sign_task(int index, void *data) {
+    struct sign_batch *batch = (struct sign_batch *)data;
+    char *path_pbo = batch->pbos[index];
+    char path_signature[2048];
+    int success;
+
+    if (batch->signature) {
+        strcpy(path_signature, batch->signature);
+    } else {
+        if (strlen(path_pbo) + strlen(batch->keyname) + 9 > sizeof(path_signature)) {
+            errorf("Failed to sign %s.\n", path_pbo);
+            return 1;
+        }
+        strcpy(path_signature, path_pbo);
+        strcat(path_signature, ".");
+        strcat(path_signature, batch->keyname);
+        strcat(path_signature, ".bisign");
+    }
+
+    // check if target already exists
+    if (access(path_signature, F_OK) != -1 && !batch->force) {
+        errorf("File %s already exists and --force was not set.\n", path_signature);
+        return 1;
+    }
+
+    success = sign_pbo(path_pbo, batch->key, path_signature);
+    if (success)
+        errorf("Failed to sign %s.\n", path_pbo);
+
+    return success;
+}
+
+
 int cmd_sign() {
+    /*
+     * Signs one or more PBOs. The private key is read once and the PBOs are
+     * signed in parallel.
+     */
+
     extern struct arguments args;
+    struct sign_batch batch;
+    struct private_key key;
     char keyname[512];
     char path_signature[2048];
     int success;
 
-    if (args.num_positionals != 3)
+    if (args.num_positionals < 3)
         return 128;
 
-    if (strcmp(strrchr(args.positionals[1], '.'), ".biprivatekey") != 0) {
+    if (args.signature && args.num_positionals > 3) {
+        errorf("--signature can only be used when signing a single PBO.\n");
+        return 1;
+    }
+
+    if (strrchr(args.positionals[1], '.') == NULL ||
+            strcmp(strrchr(args.positionals[1], '.'), ".biprivatekey") != 0) {
         errorf("File %s doesn't seem to be a valid private key.\n", args.positionals[1]);
         return 1;
     }
@@ -391,23 +659,22 @@ int cmd_sign() {
         strcpy(path_signature, args.signature);
         if (strlen(path_signature) < 7 || strcmp(&path_signature[strlen(path_signature) - 7], ".bisign") != 0)
             strcat(path_signature, ".bisign");
-    } else {
-        strcpy(path_signature, args.positionals[2]);
-        strcat(path_signature, ".");
-        strcat(path_signature, keyname);
-        strcat(path_signature, ".bisign");
     }
 
-    // check if target already exists
-    if (access(path_signature, F_OK) != -1 && !args.force) {
-        errorf("File %s already exists and --force was not set.\n", path_signature);
+    if (read_private_key(args.positionals[1], &key)) {
+        errorf("Failed to read private key %s.\n", args.positionals[1]);
         return 1;
     }
 
-    success = sign_pbo(args.positionals[2], args.positionals[1], path_signature);
+    batch.key = &key;
+    batch.keyname = keyname;
+    batch.signature = args.signature ? path_signature : NULL;
+    batch.pbos = args.positionals + 2;
+    batch.force = args.force;
 
-    if (success)
-        errorf("Failed to sign file.\n");
+    success = parallel_for(args.num_positionals - 2, sign_task, &batch);
+
+    free_private_key(&key);
 
     return success;
 }
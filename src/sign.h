@@ -19,6 +19,69 @@
 #pragma once
 
 
-int sign_pbo(char *path_pbo, char *path_privatekey, char *path_signature);
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <openssl/bn.h>
+
+#include "hash.h"
+
+
+#define SIGN_BUFFER_SIZE 65536
+
+
+struct private_key {
+    char name[512];
+    uint32_t length;
+    uint32_t exponent;
+    BIGNUM *modulus;
+    BIGNUM *p;
+    BIGNUM *q;
+    BIGNUM *dmp1;
+    BIGNUM *dmq1;
+    BIGNUM *iqmp;
+    BIGNUM *d;
+    BN_MONT_CTX *mont_p;
+    BN_MONT_CTX *mont_q;
+};
+
+struct sign_batch {
+    struct private_key *key;
+    char *keyname;
+    char *signature;
+    char **pbos;
+    bool force;
+};
+
+
+void pad_hash(unsigned char *hash, char *buffer, size_t buffsize);
+
+int name_hash_sort(const void *av, const void *bv);
+
+BIGNUM *read_key_component(FILE *f, int size);
+
+int read_private_key(char *path, struct private_key *key);
+
+void free_private_key(struct private_key *key);
+
+int rsa_sign(BIGNUM *signature, BIGNUM *hash, struct private_key *key, BN_CTX *ctx);
+
+int name_hash(char **names, int num_names, unsigned char hash[20]);
+
+int read_zstring(FILE *f, char *buffer, size_t buffsize);
+
+bool is_hashed_file(char *name);
+
+int hash_pbo(char *path_pbo, char *prefix, unsigned char namehash[20], unsigned char filehash[20], unsigned char checksum[20]);
+
+int signature_hashes(unsigned char checksum[20], unsigned char namehash[20], unsigned char filehash[20],
+        char *prefix, unsigned char hash2[20], unsigned char hash3[20]);
+
+int sign_hashes(unsigned char checksum[20], unsigned char namehash[20], unsigned char filehash[20],
+        char *prefix, struct private_key *key, char *path_signature);
+
+int sign_pbo(char *path_pbo, struct private_key *key, char *path_signature);
+
+int sign_task(int index, void *data);
 
 int cmd_sign();
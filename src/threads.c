@@ -0,0 +1,159 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "utils.h"
+#include "threads.h"
+
+
+/* set while the current thread is running tasks of a parallel job */
+__thread bool in_parallel_job = false;
+
+
+int num_threads() {
+    /*
+     * Returns the number of threads work should be split across, which is
+     * the number of online processors, capped at MAXTHREADS.
+     */
+
+    long num;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    num = (long)info.dwNumberOfProcessors;
+#else
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (num < 1)
+        return 1;
+    if (num > MAXTHREADS)
+        return MAXTHREADS;
+    return (int)num;
+}
+
+
+void run_parallel_job(struct parallel_job *job) {
+    /*
+     * Worker loop: claims task indices until the job is exhausted. The
+     * first non-zero task result is kept as the job result; later tasks
+     * still run so that every index is processed exactly once.
+     */
+
+    int i;
+    int result;
+    bool nested;
+
+    nested = in_parallel_job;
+    in_parallel_job = true;
+
+    while (true) {
+        i = __sync_fetch_and_add(&job->next_task, 1);
+        if (i >= job->num_tasks)
+            break;
+
+        result = job->task(i, job->data);
+        if (result)
+            __sync_bool_compare_and_swap(&job->result, 0, result);
+    }
+
+    in_parallel_job = nested;
+}
+
+
+#ifdef _WIN32
+DWORD WINAPI parallel_worker(LPVOID arg) {
+    run_parallel_job((struct parallel_job *)arg);
+    return 0;
+}
+#else
+void *parallel_worker(void *arg) {
+    run_parallel_job((struct parallel_job *)arg);
+    return NULL;
+}
+#endif
+
+
+int parallel_for(int num_tasks, int (*task)(int index, void *data), void *data) {
+    /*
+     * Calls task(i, data) for every i in [0, num_tasks), spread across up to
+     * num_threads() threads (including the calling one). Tasks must not
+     * depend on the order they are run in. When called from inside a task,
+     * the tasks are run on the calling thread only, so nested jobs don't
+     * multiply the number of threads.
+     *
+     * Returns 0 if all tasks succeeded, otherwise the result of the first
+     * failing task.
+     */
+
+    struct parallel_job job;
+    int num;
+    int started;
+    int i;
+#ifdef _WIN32
+    HANDLE threads[MAXTHREADS];
+#else
+    pthread_t threads[MAXTHREADS];
+#endif
+
+    job.num_tasks = num_tasks;
+    job.next_task = 0;
+    job.result = 0;
+    job.task = task;
+    job.data = data;
+
+    num = in_parallel_job ? 1 : MIN(num_threads(), num_tasks);
+
+    /* If a thread can't be created, the remaining ones pick up the slack. */
+    started = 0;
+    for (i = 1; i < num; i++) {
+#ifdef _WIN32
+        threads[started] = CreateThread(NULL, 0, parallel_worker, &job, 0, NULL);
+        if (threads[started] == NULL)
+            break;
+#else
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job) != 0)
+            break;
+#endif
+        started++;
+    }
+
+    run_parallel_job(&job);
+
+    for (i = 0; i < started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+    return job.result;
+}
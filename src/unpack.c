@@ -23,22 +23,295 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
 
 #include "args.h"
 #include "filesystem.h"
 #include "utils.h"
+#include "threads.h"
+#include "lzss.h"
 #include "unpack.h"
 
 
-bool is_garbage(struct header *header) {
+uint32_t pbo_name_hash(char *name) {
+    /* Case-insensitive FNV-1a hash of a file name. */
+
+    uint32_t hash = 2166136261u;
+
+    for (; *name != 0; name++) {
+        hash ^= (uint32_t)tolower((unsigned char)*name);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+int map_pbo(struct pbo_reader *reader, char *path) {
+    /*
+     * Maps the whole PBO into memory (read only).
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    reader->file_handle = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (reader->file_handle == INVALID_HANDLE_VALUE) {
+        reader->file_handle = NULL;
+        return 1;
+    }
+
+    if (!GetFileSizeEx(reader->file_handle, &size) || size.QuadPart == 0 ||
+            (unsigned long long)size.QuadPart > (size_t)-1)
+        return 2;
+    reader->size = (size_t)size.QuadPart;
+
+    reader->mapping_handle = CreateFileMapping(reader->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (reader->mapping_handle == NULL)
+        return 3;
+
+    reader->data = (unsigned char *)MapViewOfFile(reader->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (reader->data == NULL)
+        return 3;
+#else
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || (unsigned long long)st.st_size > (size_t)-1) {
+        close(fd);
+        return 2;
+    }
+    reader->size = (size_t)st.st_size;
+
+    data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 3;
+
+    reader->data = (unsigned char *)data;
+#endif
+
+    return 0;
+}
+
+
+char *read_pbo_string(struct pbo_reader *reader, size_t *pos) {
+    /*
+     * Returns the zero terminated string at *pos in the mapping and moves
+     * *pos past it, NULL if the string isn't terminated before the end of
+     * the PBO.
+     */
+
+    unsigned char *end;
+    char *string;
+
+    if (*pos >= reader->size)
+        return NULL;
+
+    end = (unsigned char *)memchr(reader->data + *pos, 0, reader->size - *pos);
+    if (end == NULL)
+        return NULL;
+
+    string = (char *)(reader->data + *pos);
+    *pos = end - reader->data + 1;
+
+    return string;
+}
+
+
+int open_pbo_reader(struct pbo_reader *reader, char *path) {
+    /*
+     * Opens a PBO for reading: the file is mapped into memory and the
+     * header table is parsed into an index of entries with the offsets of
+     * their data, which is then hashed by name. Names and header
+     * extensions point into the mapping, so they must not be modified.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct pbo_entry *entry;
+    uint32_t fields[5];
+    uint32_t hash;
+    size_t pos;
+    size_t offset;
+    char *name;
+    char *key;
+    char *value;
+    int i;
+    int j;
+
+    memset(reader, 0, sizeof(struct pbo_reader));
+
+    if (map_pbo(reader, path)) {
+        free_pbo_reader(reader);
+        return 1;
+    }
+
+    // header table
+    pos = 0;
+    while (true) {
+        name = read_pbo_string(reader, &pos);
+        if (name == NULL || reader->size - pos < sizeof(fields)) {
+            free_pbo_reader(reader);
+            return 2;
+        }
+
+        memcpy(fields, reader->data + pos, sizeof(fields));
+        pos += sizeof(fields);
+
+        // header extensions, in the header of an entry with an empty name
+        if (strlen(name) == 0 && reader->num_entries == 0 && !reader->has_extensions &&
+                fields[0] == PBO_VERSION) {
+            reader->has_extensions = true;
+            while (true) {
+                key = read_pbo_string(reader, &pos);
+                if (key == NULL) {
+                    free_pbo_reader(reader);
+                    return 3;
+                }
+                if (strlen(key) == 0)
+                    break;
+
+                value = read_pbo_string(reader, &pos);
+                if (value == NULL) {
+                    free_pbo_reader(reader);
+                    return 3;
+                }
+
+                if (reader->num_extensions % 32 == 0)
+                    reader->extensions = (char **)safe_realloc(reader->extensions,
+                        sizeof(char *) * (reader->num_extensions + 32));
+                reader->extensions[reader->num_extensions++] = key;
+                reader->extensions[reader->num_extensions++] = value;
+            }
+            continue;
+        }
+
+        if (strlen(name) == 0)
+            break;
+
+        if (reader->num_entries % 64 == 0)
+            reader->entries = (struct pbo_entry *)safe_realloc(reader->entries,
+                sizeof(struct pbo_entry) * (reader->num_entries + 64));
+
+        entry = &reader->entries[reader->num_entries++];
+        entry->name = name;
+        entry->packing_method = fields[0];
+        entry->original_size = fields[1];
+        entry->timestamp = fields[3];
+        entry->data_size = fields[4];
+    }
+
+    // data offsets, the data follows the header table in the same order
+    offset = pos;
+    for (i = 0; i < reader->num_entries; i++) {
+        reader->entries[i].offset = offset;
+        offset += reader->entries[i].data_size;
+    }
+
+    // open addressing with linear probing, at most half full
+    reader->index_size = 16;
+    while (reader->index_size < (size_t)reader->num_entries * 2)
+        reader->index_size *= 2;
+
+    reader->index = (int *)safe_malloc(sizeof(int) * reader->index_size);
+    for (i = 0; i < reader->index_size; i++)
+        reader->index[i] = -1;
+
+    for (i = 0; i < reader->num_entries; i++) {
+        hash = pbo_name_hash(reader->entries[i].name);
+        for (j = hash & (reader->index_size - 1); reader->index[j] != -1; j = (j + 1) & (reader->index_size - 1)) {
+            if (stricmp(reader->entries[reader->index[j]].name, reader->entries[i].name) == 0)
+                break;
+        }
+        // later duplicates replace earlier ones
+        reader->index[j] = i;
+    }
+
+    return 0;
+}
+
+
+void free_pbo_reader(struct pbo_reader *reader) {
+#ifdef _WIN32
+    if (reader->data != NULL)
+        UnmapViewOfFile(reader->data);
+    if (reader->mapping_handle != NULL)
+        CloseHandle(reader->mapping_handle);
+    if (reader->file_handle != NULL)
+        CloseHandle(reader->file_handle);
+#else
+    if (reader->data != NULL)
+        munmap(reader->data, reader->size);
+#endif
+
+    free(reader->extensions);
+    free(reader->entries);
+    free(reader->index);
+
+    memset(reader, 0, sizeof(struct pbo_reader));
+}
+
+
+int find_pbo_entry(struct pbo_reader *reader, char *name) {
+    /*
+     * Looks up an entry by name, ignoring case.
+     *
+     * Returns the index of the entry, -1 if the PBO doesn't contain it.
+     */
+
+    size_t i;
+
+    for (i = pbo_name_hash(name) & (reader->index_size - 1); reader->index[i] != -1;
+            i = (i + 1) & (reader->index_size - 1)) {
+        if (stricmp(reader->entries[reader->index[i]].name, name) == 0)
+            return reader->index[i];
+    }
+
+    return -1;
+}
+
+
+unsigned char *pbo_entry_data(struct pbo_reader *reader, int i) {
+    /*
+     * Returns a pointer to the data of the entry with the given index, NULL
+     * if it extends past the end of the PBO.
+     */
+
+    struct pbo_entry *entry = &reader->entries[i];
+
+    if (entry->offset > reader->size || reader->size - entry->offset < entry->data_size)
+        return NULL;
+
+    return reader->data + entry->offset;
+}
+
+
+bool is_garbage(struct pbo_entry *entry) {
     int i;
     char c;
 
-    if (header->packing_method != 0)
+    if (entry->packing_method != 0 && entry->packing_method != PBO_COMPRESSED)
         return true;
 
-    for (i = 0; i < strlen(header->name); i++) {
-        c = header->name[i];
+    for (i = 0; i < strlen(entry->name); i++) {
+        c = entry->name[i];
         if (c <= 31)
             return true;
         if (c == '"' ||
@@ -56,107 +329,150 @@ bool is_garbage(struct header *header) {
 }
 
 
-int cmd_inspect() {
-    extern struct arguments args;
-    extern char *current_target;
-    FILE *f_target;
-    int num_files;
-    long i;
-    long fp_tmp;
-    char buffer[2048];
-    struct header *headers;
+int write_pbo_entry(struct pbo_reader *reader, int i, FILE *f) {
+    /*
+     * Writes the (decompressed) data of the entry with the given index to
+     * f. Compressed entries are decoded straight from the mapping.
+     *
+     * Returns 0 on success, 1 if the data extends past the end of the PBO,
+     * 2 if it can't be decompressed and 3 if writing fails.
+     */
 
-    if (args.num_positionals != 2)
-        return 128;
+    struct pbo_entry *entry = &reader->entries[i];
+    unsigned char *data;
+    int success;
 
-    headers = (struct header *)safe_malloc(sizeof(struct header) * MAXFILES);
+    data = pbo_entry_data(reader, i);
+    if (data == NULL)
+        return 1;
 
-    current_target = args.positionals[1];
+    if (entry->packing_method == PBO_COMPRESSED) {
+        success = lzss_decompress_file(data, entry->data_size, entry->original_size, f, false);
+        return success == 3 ? 3 : (success ? 2 : 0);
+    }
+
+    if (entry->data_size > 0 && fwrite(data, entry->data_size, 1, f) != 1)
+        return 3;
+
+    return 0;
+}
+
+
+int folder_sort(const void *av, const void *bv) {
+    /*
+     * Compares two file paths by their containing folders, so sorting
+     * groups files in the same folder.
+     */
+
+    const char *a = *((const char **)av);
+    const char *b = *((const char **)bv);
+    size_t len_a = strrchr(a, PATHSEP) - a;
+    size_t len_b = strrchr(b, PATHSEP) - b;
+    int result;
+
+    result = strncmp(a, b, MIN(len_a, len_b));
+    if (result != 0)
+        return result;
+
+    return (len_a > len_b) - (len_a < len_b);
+}
+
+
+int path_sort(const void *av, const void *bv) {
+    /*
+     * Compares two slots of the batch path array by their paths, equal
+     * paths by their position in the array.
+     */
 
-    // remove trailing slash in target
-    if (args.positionals[1][strlen(args.positionals[1]) - 1] == PATHSEP)
-        args.positionals[1][strlen(args.positionals[1]) - 1] = 0;
+    char **a = *((char ***)av);
+    char **b = *((char ***)bv);
+    int result;
 
-    // open file
-    f_target = fopen(args.positionals[1], "rb");
+    result = compare_paths(*a, *b);
+    if (result != 0)
+        return result;
+
+    return (a > b) - (a < b);
+}
+
+
+int unpack_task(int index, void *data) {
+    /*
+     * Writes one file of an unpack batch straight from the mapped PBO. Its
+     * folder has to exist already.
+     */
+
+    struct unpack_batch *batch = (struct unpack_batch *)data;
+    struct pbo_entry *entry = &batch->reader->entries[batch->indices[index]];
+    char *path = batch->paths[index];
+    FILE *f_target;
+    int success;
+
+    f_target = fopen(path, "wb");
     if (!f_target) {
-        errorf("Failed to open %s.\n", args.positionals[1]);
-        free(headers);
-        return 1;
+        errorf("Failed to open file %s.\n", path);
+        return 8;
     }
 
-    // read header extensions
-    fseek(f_target, 1, SEEK_SET);
-    fgets(buffer, 5, f_target);
-    if (strncmp(buffer, "sreV", 4) == 0) {
-        fseek(f_target, 21, SEEK_SET);
-        printf("Header extensions:\n");
-        while (true) {
-            fp_tmp = ftell(f_target);
-            fgets(buffer, 2048, f_target);
-            if (strnlen(buffer, 2048) == 2048) {
-                errorf("Header extension exceeds maximum size.");
-                return 4;
-            }
-            fseek(f_target, fp_tmp + strlen(buffer) + 1, SEEK_SET);
+    success = write_pbo_entry(batch->reader, batch->indices[index], f_target);
+    if (success) {
+        if (success == 2)
+            errorf("Failed to decompress %s.\n", entry->name);
+        else
+            errorf("Failed to write file %s.\n", path);
+        fclose(f_target);
+        return 8;
+    }
 
-            if (strlen(buffer) == 0)
-                break;
+    if (fclose(f_target)) {
+        errorf("Failed to write file %s.\n", path);
+        return 8;
+    }
 
-            printf("- %s=", buffer);
+    return 0;
+}
 
-            fp_tmp = ftell(f_target);
-            fgets(buffer, 2048, f_target);
-            if (strnlen(buffer, 2048) == 2048) {
-                errorf("Header extension exceeds maximum size.");
-                return 4;
-            }
-            fseek(f_target, fp_tmp + strlen(buffer) + 1, SEEK_SET);
 
-            printf("%s\n", buffer);
-        }
-        printf("\n");
-    } else {
-        fseek(f_target, 0, SEEK_SET);
-    }
+int cmd_inspect() {
+    extern struct arguments args;
+    extern char *current_target;
+    struct pbo_reader reader;
+    struct pbo_entry *entry;
+    uint32_t original_size;
+    int i;
 
-    // read headers
-    for (num_files = 0; num_files <= MAXFILES; num_files++) {
-        fp_tmp = ftell(f_target);
-        fgets(buffer, sizeof(buffer), f_target);
-        fseek(f_target, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-        if (strlen(buffer) == 0) {
-            fseek(f_target, sizeof(uint32_t) * 5, SEEK_CUR);
-            break;
-        }
+    if (args.num_positionals != 2)
+        return 128;
 
-        strcpy(headers[num_files].name, buffer);
-        fread(&headers[num_files].packing_method, sizeof(uint32_t), 1, f_target);
-        fread(&headers[num_files].original_size, sizeof(uint32_t), 1, f_target);
-        fseek(f_target, sizeof(uint32_t) * 2, SEEK_CUR);
-        fread(&headers[num_files].data_size, sizeof(uint32_t), 1, f_target);
+    current_target = args.positionals[1];
+
+    if (open_pbo_reader(&reader, args.positionals[1])) {
+        errorf("Failed to read %s.\n", args.positionals[1]);
+        return 1;
     }
-    if (num_files > MAXFILES) {
-        errorf("Maximum number of files (%i) exceeded.\n", MAXFILES);
-        fclose(f_target);
-        free(headers);
-        return 4;
+
+    if (reader.has_extensions) {
+        printf("Header extensions:\n");
+        for (i = 0; i < reader.num_extensions; i += 2)
+            printf("- %s=%s\n", reader.extensions[i], reader.extensions[i + 1]);
+        printf("\n");
     }
 
-    printf("# Files: %i\n\n", num_files);
+    printf("# Files: %i\n\n", reader.num_entries);
 
     printf("Path                                                  Method  Original    Packed\n");
     printf("                                                                  Size      Size\n");
     printf("================================================================================\n");
-    for (i = 0; i < num_files; i++) {
-        if (headers[i].original_size == 0)
-            headers[i].original_size = headers[i].data_size;
-        printf("%-50s %9u %9u %9u\n", headers[i].name, headers[i].packing_method, headers[i].original_size, headers[i].data_size);
+    for (i = 0; i < reader.num_entries; i++) {
+        entry = &reader.entries[i];
+        original_size = entry->original_size == 0 ? entry->data_size : entry->original_size;
+        if (entry->packing_method == PBO_COMPRESSED)
+            printf("%-50s %9s %9u %9u\n", entry->name, "Cprs", original_size, entry->data_size);
+        else
+            printf("%-50s %9u %9u %9u\n", entry->name, entry->packing_method, original_size, entry->data_size);
     }
 
-    // clean up
-    fclose(f_target);
-    free(headers);
+    free_pbo_reader(&reader);
 
     return 0;
 }
@@ -165,36 +481,33 @@ int cmd_inspect() {
 int cmd_unpack() {
     extern struct arguments args;
     extern char *current_target;
-    FILE *f_source;
+    struct pbo_reader reader;
+    struct pbo_entry *entry;
+    struct unpack_batch batch;
     FILE *f_target;
-    int num_files;
+    char **folders;
+    char ***slots;
+    int num_folders;
+    int success;
     long i;
     long j;
-    long fp_tmp;
     char full_path[2048];
     char buffer[2048];
-    struct header *headers;
 
     if (args.num_positionals < 3)
         return 128;
 
-    headers = (struct header *)safe_malloc(sizeof(struct header) * MAXFILES);
-
     current_target = args.positionals[1];
 
-    // open file
-    f_source = fopen(args.positionals[1], "rb");
-    if (!f_source) {
-        errorf("Failed to open %s.\n", args.positionals[1]);
-        free(headers);
+    if (open_pbo_reader(&reader, args.positionals[1])) {
+        errorf("Failed to read %s.\n", args.positionals[1]);
         return 1;
     }
 
     // create folder
     if (create_folders(args.positionals[2])) {
         errorf("Failed to create output folder %s.\n", args.positionals[2]);
-        fclose(f_source);
-        free(headers);
+        free_pbo_reader(&reader);
         return 2;
     }
 
@@ -204,261 +517,201 @@ int cmd_unpack() {
     strcat(full_path, "$PBOPREFIX$");
     if (access(full_path, F_OK) != -1 && !args.force) {
         errorf("File %s already exists and --force was not set.\n", full_path);
-        fclose(f_source);
-        free(headers);
+        free_pbo_reader(&reader);
         return 3;
     }
 
-    // read header extensions
-    fseek(f_source, 1, SEEK_SET);
-    fgets(buffer, 5, f_source);
-    if (strncmp(buffer, "sreV", 4) == 0) {
-        fseek(f_source, 21, SEEK_SET);
-
-        // open header extensions file
+    if (reader.has_extensions) {
         f_target = fopen(full_path, "wb");
         if (!f_target) {
             errorf("Failed to open file %s.\n", full_path);
-            fclose(f_source);
-            free(headers);
+            free_pbo_reader(&reader);
             return 4;
         }
 
-        // read all header extensions
-        while (true) {
-            fp_tmp = ftell(f_source);
-            fgets(buffer, 2048, f_source);
-            if (strnlen(buffer, 2048) == 2048) {
-                errorf("Header extension exceeds maximum size.");
-                return 4;
-            }
-            fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-
-            if (strlen(buffer) == 0)
-                break;
-
-            fprintf(f_target, "%s=", buffer);
+        for (i = 0; i < reader.num_extensions; i += 2)
+            fprintf(f_target, "%s=%s\n", reader.extensions[i], reader.extensions[i + 1]);
 
-            fp_tmp = ftell(f_source);
-            fgets(buffer, 2048, f_source);
-            if (strnlen(buffer, 2048) == 2048) {
-                errorf("Header extension exceeds maximum size.");
-                return 4;
-            }
-            fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-
-            fprintf(f_target, "%s\n", buffer);
-        }
-    } else {
-        fseek(f_source, 0, SEEK_SET);
+        fclose(f_target);
     }
 
-    // read headers
-    for (num_files = 0; num_files <= MAXFILES; num_files++) {
-        fp_tmp = ftell(f_source);
-        fgets(buffer, sizeof(buffer), f_source);
-        fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-        if (strlen(buffer) == 0) {
-            fseek(f_source, sizeof(uint32_t) * 5, SEEK_CUR);
-            break;
-        }
+    batch.reader = &reader;
+    batch.indices = NULL;
+    batch.paths = NULL;
+    batch.num_files = 0;
+    success = 0;
 
-        strcpy(headers[num_files].name, buffer);
-        fread(&headers[num_files].packing_method, sizeof(uint32_t), 1, f_source);
-        fread(&headers[num_files].original_size, sizeof(uint32_t), 1, f_source);
-        fseek(f_source, sizeof(uint32_t) * 2, SEEK_CUR);
-        fread(&headers[num_files].data_size, sizeof(uint32_t), 1, f_source);
-    }
-    if (num_files > MAXFILES) {
-        errorf("Maximum number of files (%i) exceeded.\n", MAXFILES);
-        fclose(f_source);
-        free(headers);
-        return 5;
-    }
+    // select files and get their paths
+    for (i = 0; i < reader.num_entries; i++) {
+        entry = &reader.entries[i];
 
-    // read files
-    for (i = 0; i < num_files; i++) {
         // check for garbage
-        if (is_garbage(&headers[i])) {
-            fseek(f_source, headers[i].data_size, SEEK_CUR);
+        if (is_garbage(entry))
             continue;
-        }
 
         // check if file is excluded
         for (j = 0; j < args.num_excludefiles; j++) {
-            if (matches_glob(headers[i].name, args.excludefiles[j]))
+            if (matches_glob(entry->name, args.excludefiles[j]))
                 break;
         }
-        if (j < args.num_excludefiles) {
-            fseek(f_source, headers[i].data_size, SEEK_CUR);
+        if (j < args.num_excludefiles)
             continue;
-        }
 
         // check if file is included
         for (j = 1; j < args.num_includefolders; j++) {
-            if (matches_glob(headers[i].name, args.includefolders[j]))
+            if (matches_glob(entry->name, args.includefolders[j]))
                 break;
         }
-        if (args.num_includefolders > 1 && j == args.num_includefolders) {
-            fseek(f_source, headers[i].data_size, SEEK_CUR);
+        if (args.num_includefolders > 1 && j == args.num_includefolders)
             continue;
-        }
 
-        // replace pathseps on linux
-#ifndef _WIN32
-        for (j = 0; j < strlen(headers[i].name); j++) {
-            if (headers[i].name[j] == '\\')
-                headers[i].name[j] = PATHSEP;
+        if (pbo_entry_data(&reader, i) == NULL) {
+            errorf("File %s extends past the end of the PBO.\n", entry->name);
+            success = 5;
+            goto cleanup;
         }
-#endif
 
         // get full path
+        if (strlen(args.positionals[2]) + strlen(entry->name) + 2 > sizeof(full_path)) {
+            errorf("Path for %s is too long.\n", entry->name);
+            success = 6;
+            goto cleanup;
+        }
         strcpy(full_path, args.positionals[2]);
         strcat(full_path, PATHSEP_STR);
-        strcat(full_path, headers[i].name);
+        strcat(full_path, entry->name);
 
-        // create containing folder
-        strcpy(buffer, full_path);
-        if (strrchr(buffer, PATHSEP) != NULL) {
-            *strrchr(buffer, PATHSEP) = 0;
-            if (create_folders(buffer)) {
-                errorf("Failed to create folder %s.\n", buffer);
-                fclose(f_source);
-                return 6;
-            }
+        // replace pathseps on linux
+#ifndef _WIN32
+        for (j = strlen(args.positionals[2]); j < strlen(full_path); j++) {
+            if (full_path[j] == '\\')
+                full_path[j] = PATHSEP;
         }
+#endif
 
-        // open target file
         if (access(full_path, F_OK) != -1 && !args.force) {
             errorf("File %s already exists and --force was not set.\n", full_path);
-            fclose(f_source);
-            return 7;
+            success = 7;
+            goto cleanup;
         }
-        f_target = fopen(full_path, "wb");
-        if (!f_target) {
-            errorf("Failed to open file %s.\n", full_path);
-            fclose(f_source);
-            return 8;
+
+        if (batch.num_files % 64 == 0) {
+            batch.indices = (int *)safe_realloc(batch.indices, sizeof(int) * (batch.num_files + 64));
+            batch.paths = (char **)safe_realloc(batch.paths, sizeof(char *) * (batch.num_files + 64));
         }
+        batch.indices[batch.num_files] = i;
+        batch.paths[batch.num_files] = safe_strdup(full_path);
+        batch.num_files++;
+    }
 
-        // write to file
-        for (j = 0; headers[i].data_size - j >= sizeof(buffer); j += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_source);
-            fwrite(buffer, sizeof(buffer), 1, f_target);
+    // of files with the same target only the last one is written, they would race otherwise
+    if (batch.num_files > 1) {
+        slots = (char ***)safe_malloc(sizeof(char **) * batch.num_files);
+        for (i = 0; i < batch.num_files; i++)
+            slots[i] = &batch.paths[i];
+
+        qsort(slots, batch.num_files, sizeof(char **), path_sort);
+
+        for (i = 0; i < batch.num_files - 1; i++) {
+            if (compare_paths(*slots[i], *slots[i + 1]) == 0) {
+                free(*slots[i]);
+                *slots[i] = NULL;
+            }
         }
-        fread(buffer, headers[i].data_size - j, 1, f_source);
-        fwrite(buffer, headers[i].data_size - j, 1, f_target);
 
-        // clean up
-        fclose(f_target);
+        free(slots);
+
+        for (i = 0, j = 0; i < batch.num_files; i++) {
+            if (batch.paths[i] == NULL)
+                continue;
+            batch.indices[j] = batch.indices[i];
+            batch.paths[j] = batch.paths[i];
+            j++;
+        }
+        batch.num_files = j;
     }
 
-    // clean up
-    fclose(f_source);
-    free(headers);
+    // create the folder tree up front, every folder once
+    if (batch.num_files > 0) {
+        folders = (char **)safe_malloc(sizeof(char *) * batch.num_files);
+        num_folders = 0;
+        for (i = 0; i < batch.num_files; i++) {
+            if (strrchr(batch.paths[i], PATHSEP) != NULL)
+                folders[num_folders++] = batch.paths[i];
+        }
 
-    return 0;
+        qsort(folders, num_folders, sizeof(char *), folder_sort);
+
+        for (i = 0; i < num_folders; i++) {
+            if (i > 0 && folder_sort(&folders[i - 1], &folders[i]) == 0)
+                continue;
+
+            strcpy(buffer, folders[i]);
+            *strrchr(buffer, PATHSEP) = 0;
+            if (create_folders(buffer)) {
+                errorf("Failed to create folder %s.\n", buffer);
+                success = 6;
+                break;
+            }
+        }
+
+        free(folders);
+        if (success)
+            goto cleanup;
+    }
+
+    success = parallel_for(batch.num_files, unpack_task, &batch);
+
+cleanup:
+    for (i = 0; i < batch.num_files; i++)
+        free(batch.paths[i]);
+    free(batch.paths);
+    free(batch.indices);
+    free_pbo_reader(&reader);
+
+    return success;
 }
 
 
 int cmd_cat() {
     extern struct arguments args;
     extern char *current_target;
-    FILE *f_source;
-    int num_files;
+    struct pbo_reader reader;
     int file_index;
-    long i;
-    long j;
-    long fp_tmp;
-    char buffer[2048];
-    struct header *headers;
+    int success;
 
     if (args.num_positionals < 3)
         return 128;
 
-    headers = (struct header *)safe_malloc(sizeof(struct header) * MAXFILES);
-
     current_target = args.positionals[1];
 
-    // open file
-    f_source = fopen(args.positionals[1], "rb");
-    if (!f_source) {
-        errorf("Failed to open %s.\n", args.positionals[1]);
-        free(headers);
+    if (open_pbo_reader(&reader, args.positionals[1])) {
+        errorf("Failed to read %s.\n", args.positionals[1]);
         return 1;
     }
 
-    // read header extensions
-    fseek(f_source, 1, SEEK_SET);
-    fgets(buffer, 5, f_source);
-    if (strncmp(buffer, "sreV", 4) == 0) {
-        fseek(f_source, 21, SEEK_SET);
-        i = 0;
-        while (true) {
-            fp_tmp = ftell(f_source);
-            buffer[i++] = fgetc(f_source);
-            buffer[i] = '\0';
-            if (buffer[i - 1] == '\0' && buffer[i - 2] == '\0')
-                break;
-        }
-    } else {
-        fseek(f_source, 0, SEEK_SET);
-    }
-
-    // read headers
-    file_index = -1;
-    for (num_files = 0; num_files <= MAXFILES; num_files++) {
-        fp_tmp = ftell(f_source);
-        fgets(buffer, sizeof(buffer), f_source);
-        fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
-        if (strlen(buffer) == 0) {
-            fseek(f_source, sizeof(uint32_t) * 5, SEEK_CUR);
-            break;
-        }
-
-        if (stricmp(args.positionals[2], buffer) == 0)
-            file_index = num_files;
-
-        strcpy(headers[num_files].name, buffer);
-        fread(&headers[num_files].packing_method, sizeof(uint32_t), 1, f_source);
-        fread(&headers[num_files].original_size, sizeof(uint32_t), 1, f_source);
-        fseek(f_source, sizeof(uint32_t) * 2, SEEK_CUR);
-        fread(&headers[num_files].data_size, sizeof(uint32_t), 1, f_source);
-    }
-
-    if (num_files > MAXFILES) {
-        errorf("Maximum number of files (%i) exceeded.\n", MAXFILES);
-        fclose(f_source);
-        free(headers);
-        return 4;
-    }
-
+    file_index = find_pbo_entry(&reader, args.positionals[2]);
     if (file_index == -1) {
         errorf("PBO does not contain the file %s.\n", args.positionals[2]);
-        fclose(f_source);
-        free(headers);
+        free_pbo_reader(&reader);
         return 5;
     }
 
-    // read files
-    for (i = 0; i < num_files; i++) {
-        if (i != file_index) {
-            fseek(f_source, headers[i].data_size, SEEK_CUR);
-            continue;
-        }
-
-        // write to file
-        for (j = 0; headers[i].data_size - j >= sizeof(buffer); j += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_source);
-            fwrite(buffer, sizeof(buffer), 1, stdout);
-        }
-        fread(buffer, headers[i].data_size - j, 1, f_source);
-        fwrite(buffer, headers[i].data_size - j, 1, stdout);
+    success = write_pbo_entry(&reader, file_index, stdout);
+    if (success == 1)
+        errorf("File %s extends past the end of the PBO.\n", args.positionals[2]);
+    else if (success == 2)
+        errorf("Failed to decompress %s.\n", args.positionals[2]);
+    else if (success)
+        errorf("Failed to write %s.\n", args.positionals[2]);
+
+    if (success) {
+        free_pbo_reader(&reader);
+        return 6;
     }
 
     // clean up
-    fclose(f_source);
-    free(headers);
+    free_pbo_reader(&reader);
 
     return 0;
 }
@@ -19,7 +19,14 @@
 #pragma once
 
 
-#define MAXFILES 4096
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+#define PBO_VERSION 0x56657273 // "sreV"
+#define PBO_COMPRESSED 0x43707273 // "Cprs"
 
 
 struct header {
@@ -29,6 +36,62 @@ struct header {
     uint32_t data_size;
 };
 
+struct pbo_entry {
+    char *name;
+    uint32_t packing_method;
+    uint32_t original_size;
+    uint32_t timestamp;
+    uint32_t data_size;
+    size_t offset;
+};
+
+struct pbo_reader {
+    unsigned char *data;
+    size_t size;
+    bool has_extensions;
+    char **extensions;
+    int num_extensions;
+    struct pbo_entry *entries;
+    int num_entries;
+    int *index;
+    size_t index_size;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+};
+
+struct unpack_batch {
+    struct pbo_reader *reader;
+    int *indices;
+    char **paths;
+    int num_files;
+};
+
+
+uint32_t pbo_name_hash(char *name);
+
+int map_pbo(struct pbo_reader *reader, char *path);
+
+char *read_pbo_string(struct pbo_reader *reader, size_t *pos);
+
+int open_pbo_reader(struct pbo_reader *reader, char *path);
+
+void free_pbo_reader(struct pbo_reader *reader);
+
+int find_pbo_entry(struct pbo_reader *reader, char *name);
+
+unsigned char *pbo_entry_data(struct pbo_reader *reader, int i);
+
+bool is_garbage(struct pbo_entry *entry);
+
+int write_pbo_entry(struct pbo_reader *reader, int i, FILE *f);
+
+int folder_sort(const void *av, const void *bv);
+
+int path_sort(const void *av, const void *bv);
+
+int unpack_task(int index, void *data);
 
 int cmd_inspect();
 
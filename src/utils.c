@@ -661,3 +661,15 @@ uint32_t read_compressed_int(FILE *f) {
 
     return (uint32_t)result;
 }
+
+
+uint32_t hash_name(char *name) {
+    // FNV-1a
+    uint32_t hash;
+
+    hash = 2166136261u;
+    for (; *name != 0; name++)
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+
+    return hash;
+}
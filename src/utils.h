@@ -118,3 +118,5 @@ void unescape_string(char *buffer, size_t buffsize);
 void write_compressed_int(uint32_t integer, FILE *f);
 
 uint32_t read_compressed_int(FILE *f);
+
+uint32_t hash_name(char *name);
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/bn.h>
+
+#include "args.h"
+#include "filesystem.h"
+#include "utils.h"
+#include "hash.h"
+#include "threads.h"
+#include "sign.h"
+#include "verify.h"
+
+
+int read_public_key(FILE *f, struct public_key *key) {
+    /*
+     * Reads a public key (a PUBLICKEYBLOB prefixed by the key name) from the
+     * current position of the file, which is how both .bikey files and
+     * .bisign files start. A Montgomery context for the modulus is set up
+     * so it can be reused for every verification.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    uint32_t exponent;
+    uint32_t temp;
+    char header[12];
+    BN_CTX *ctx;
+    bool failed;
+
+    memset(key, 0, sizeof(struct public_key));
+
+    if (read_zstring(f, key->name, sizeof(key->name)) ||
+            fread(&temp, sizeof(temp), 1, f) != 1 ||
+            fread(header, sizeof(header), 1, f) != 1 ||
+            fread(&key->length, sizeof(key->length), 1, f) != 1 ||
+            fread(&exponent, sizeof(exponent), 1, f) != 1)
+        return 1;
+
+    if (memcmp(header + 8, "RSA1", 4) != 0 || key->length == 0 ||
+            key->length % 8 != 0 || key->length / 8 > 4096)
+        return 2;
+
+    key->modulus = read_key_component(f, key->length / 8);
+    key->exponent = BN_new();
+    if (!key->modulus || !key->exponent || !BN_set_word(key->exponent, exponent)) {
+        free_public_key(key);
+        return 3;
+    }
+
+    ctx = BN_CTX_new();
+    key->mont = BN_MONT_CTX_new();
+    failed = !ctx || !key->mont || !BN_MONT_CTX_set(key->mont, key->modulus, ctx);
+    BN_CTX_free(ctx);
+
+    if (failed) {
+        free_public_key(key);
+        return 4;
+    }
+
+    return 0;
+}
+
+
+void free_public_key(struct public_key *key) {
+    BN_free(key->exponent);
+    BN_free(key->modulus);
+    BN_MONT_CTX_free(key->mont);
+    memset(key, 0, sizeof(struct public_key));
+}
+
+
+int rsa_verify(BIGNUM *signature, unsigned char hash[20], struct public_key *key, BN_CTX *ctx) {
+    /*
+     * Checks that signature^e mod n is the padded hash.
+     *
+     * Returns 0 if the signature matches and a positive integer otherwise.
+     */
+
+    BIGNUM *expected;
+    BIGNUM *result;
+    char buffer[4096];
+    int success;
+
+    if (BN_cmp(signature, key->modulus) >= 0)
+        return 1;
+
+    BN_CTX_start(ctx);
+    expected = BN_CTX_get(ctx);
+    result = BN_CTX_get(ctx);
+
+    success = 2;
+    if (!result)
+        goto cleanup;
+
+    pad_hash(hash, buffer, key->length / 8);
+    if (!BN_bin2bn((unsigned char *)buffer, key->length / 8, expected) ||
+            !BN_mod_exp_mont(result, signature, key->exponent, key->modulus, ctx, key->mont))
+        goto cleanup;
+
+    success = BN_cmp(result, expected) != 0;
+
+cleanup:
+    BN_CTX_end(ctx);
+
+    return success;
+}
+
+
+int pbo_checksum(char *path_pbo, unsigned char checksum[20]) {
+    /*
+     * Computes the checksum of a PBO, which is the SHA1 of everything but
+     * the trailing zero byte and the stored checksum itself. Unlike the
+     * signature, this covers the files that are left out of the file hash.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    struct sha1 sha;
+    FILE *f_pbo;
+    unsigned char *buffer;
+    long remaining;
+    size_t chunk;
+    int success;
+
+    f_pbo = fopen(path_pbo, "rb");
+    if (!f_pbo)
+        return 1;
+
+    fseek(f_pbo, 0, SEEK_END);
+    remaining = ftell(f_pbo) - 21;
+    fseek(f_pbo, 0, SEEK_SET);
+
+    if (remaining < 0) {
+        fclose(f_pbo);
+        return 2;
+    }
+
+    buffer = (unsigned char *)safe_malloc(SIGN_BUFFER_SIZE);
+    sha1_init(&sha);
+    success = 3;
+
+    for (; remaining > 0; remaining -= chunk) {
+        chunk = MIN(remaining, SIGN_BUFFER_SIZE);
+        if (fread(buffer, chunk, 1, f_pbo) != 1)
+            goto cleanup;
+        sha1_update(&sha, buffer, chunk);
+    }
+
+    success = sha1_final(&sha, checksum);
+
+cleanup:
+    sha1_free(&sha);
+    fclose(f_pbo);
+    free(buffer);
+
+    return success;
+}
+
+
+int verify_pbo(char *path_pbo, char *path_signature, struct public_key *key) {
+    /*
+     * Verifies a version 2 signature of a PBO against the given key, as
+     * well as the PBO's checksum the first signature is made of. The key is
+     * only read from, so it can be shared between threads.
+     *
+     * Returns 0 if the signature is valid, 1 if the PBO can't be read, 2 if
+     * the signature can't be read, 3 if it was made with a different key, 4
+     * if its version is not supported and 5 if it doesn't match the PBO.
+     */
+
+    struct public_key signer;
+    BIGNUM *sigs[3];
+    BN_CTX *ctx;
+    FILE *f_signature;
+    uint32_t length;
+    uint32_t version;
+    char prefix[512];
+    unsigned char checksum[20];
+    unsigned char actual_checksum[20];
+    unsigned char namehash[20];
+    unsigned char filehash[20];
+    unsigned char hash2[20];
+    unsigned char hash3[20];
+    int success;
+    int i;
+
+    f_signature = fopen(path_signature, "rb");
+    if (!f_signature)
+        return 2;
+
+    sigs[0] = sigs[1] = sigs[2] = NULL;
+    ctx = NULL;
+
+    if (read_public_key(f_signature, &signer)) {
+        fclose(f_signature);
+        return 2;
+    }
+
+    success = 3;
+    if (BN_cmp(signer.modulus, key->modulus) != 0 || BN_cmp(signer.exponent, key->exponent) != 0)
+        goto cleanup;
+
+    // signature 1, version, signature 2 and 3, each signature prefixed by its length
+    success = 2;
+    for (i = 0; i < 3; i++) {
+        if (i == 1) {
+            if (fread(&version, sizeof(version), 1, f_signature) != 1)
+                goto cleanup;
+            if (version != 2) {
+                success = 4;
+                goto cleanup;
+            }
+        }
+
+        if (fread(&length, sizeof(length), 1, f_signature) != 1 || length != key->length / 8)
+            goto cleanup;
+
+        sigs[i] = read_key_component(f_signature, length);
+        if (!sigs[i])
+            goto cleanup;
+    }
+
+    success = 1;
+    if (hash_pbo(path_pbo, prefix, namehash, filehash, checksum) ||
+            signature_hashes(checksum, namehash, filehash, prefix, hash2, hash3) ||
+            pbo_checksum(path_pbo, actual_checksum))
+        goto cleanup;
+
+    ctx = BN_CTX_new();
+    success = 5;
+    if (!ctx || memcmp(checksum, actual_checksum, 20) != 0 || rsa_verify(sigs[0], checksum, key, ctx) ||
+            rsa_verify(sigs[1], hash2, key, ctx) ||
+            rsa_verify(sigs[2], hash3, key, ctx))
+        goto cleanup;
+
+    success = 0;
+
+cleanup:
+    fclose(f_signature);
+    free_public_key(&signer);
+    for (i = 0; i < 3; i++)
+        BN_free(sigs[i]);
+    BN_CTX_free(ctx);
+
+    return success;
+}
+
+
+int verify_callback(char *root, char *source, char *data) {
+    struct verify_batch *batch = (struct verify_batch *)data;
+    char *extension;
+
+    extension = strrchr(source, '.');
+    if (extension == NULL || stricmp(extension, ".pbo") != 0)
+        return 0;
+
+    if (batch->num_pbos % VERIFYINTERVAL == 0)
+        batch->pbos = (char **)safe_realloc(batch->pbos, sizeof(char *) * (batch->num_pbos + VERIFYINTERVAL));
+
+    batch->pbos[batch->num_pbos++] = safe_strdup(source);
+
+    return 0;
+}
+
+
+int verify_task(int index, void *data) {
+    struct verify_batch *batch = (struct verify_batch *)data;
+    char *path_pbo = batch->pbos[index];
+    char path_signature[2048];
+    int success;
+
+    if (batch->signature) {
+        if (strlen(batch->signature) + 1 > sizeof(path_signature)) {
+            errorf("Failed to verify %s.\n", path_pbo);
+            return 1;
+        }
+        strcpy(path_signature, batch->signature);
+    } else {
+        if (strlen(path_pbo) + strlen(batch->key->name) + 9 > sizeof(path_signature)) {
+            errorf("Failed to verify %s.\n", path_pbo);
+            return 1;
+        }
+        strcpy(path_signature, path_pbo);
+        strcat(path_signature, ".");
+        strcat(path_signature, batch->key->name);
+        strcat(path_signature, ".bisign");
+    }
+
+    success = verify_pbo(path_pbo, path_signature, batch->key);
+
+    if (success == 1)
+        errorf("Failed to read %s.\n", path_pbo);
+    else if (success == 2)
+        errorf("Failed to read signature %s.\n", path_signature);
+    else if (success == 3)
+        errorf("%s was not signed with %s.\n", path_pbo, batch->key->name);
+    else if (success == 4)
+        errorf("Signature %s has an unsupported version.\n", path_signature);
+    else if (success)
+        errorf("Signature %s doesn't match %s.\n", path_signature, path_pbo);
+
+    return success;
+}
+
+
+int cmd_verify() {
+    /*
+     * Verifies the signatures of one or more PBOs, or of all PBOs found in
+     * the given folders, against a public key. Verification is spread
+     * across threads.
+     */
+
+    extern struct arguments args;
+    struct verify_batch batch;
+    struct public_key key;
+    struct stat st;
+    FILE *f_key;
+    char *path;
+    int success;
+    int i;
+
+    if (args.num_positionals < 3)
+        return 128;
+
+    if (strrchr(args.positionals[1], '.') == NULL ||
+            strcmp(strrchr(args.positionals[1], '.'), ".bikey") != 0) {
+        errorf("File %s doesn't seem to be a valid public key.\n", args.positionals[1]);
+        return 1;
+    }
+
+    f_key = fopen(args.positionals[1], "rb");
+    if (!f_key || read_public_key(f_key, &key)) {
+        errorf("Failed to read public key %s.\n", args.positionals[1]);
+        if (f_key)
+            fclose(f_key);
+        return 1;
+    }
+    fclose(f_key);
+
+    batch.key = &key;
+    batch.signature = NULL;
+    batch.pbos = NULL;
+    batch.num_pbos = 0;
+
+    // a single PBO may be followed by its signature
+    path = args.positionals[args.num_positionals - 1];
+    if (args.num_positionals == 4 && strlen(path) > 7 && stricmp(path + strlen(path) - 7, ".bisign") == 0) {
+        batch.signature = path;
+        batch.pbos = (char **)safe_malloc(sizeof(char *));
+        batch.pbos[0] = safe_strdup(args.positionals[2]);
+        batch.num_pbos = 1;
+    } else {
+        for (i = 2; i < args.num_positionals; i++) {
+            path = args.positionals[i];
+
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+                if (traverse_directory(path, verify_callback, (char *)&batch)) {
+                    errorf("Failed to read folder %s.\n", path);
+                    success = 2;
+                    goto cleanup;
+                }
+                continue;
+            }
+
+            if (batch.num_pbos % VERIFYINTERVAL == 0)
+                batch.pbos = (char **)safe_realloc(batch.pbos, sizeof(char *) * (batch.num_pbos + VERIFYINTERVAL));
+            batch.pbos[batch.num_pbos++] = safe_strdup(path);
+        }
+    }
+
+    success = parallel_for(batch.num_pbos, verify_task, &batch);
+
+cleanup:
+    for (i = 0; i < batch.num_pbos; i++)
+        free(batch.pbos[i]);
+    free(batch.pbos);
+    free_public_key(&key);
+
+    return success;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <openssl/bn.h>
+
+
+#define VERIFYINTERVAL 64
+
+
+struct public_key {
+    char name[512];
+    uint32_t length;
+    BIGNUM *exponent;
+    BIGNUM *modulus;
+    BN_MONT_CTX *mont;
+};
+
+struct verify_batch {
+    struct public_key *key;
+    char *signature;
+    char **pbos;
+    int num_pbos;
+};
+
+
+int read_public_key(FILE *f, struct public_key *key);
+
+void free_public_key(struct public_key *key);
+
+int rsa_verify(BIGNUM *signature, unsigned char hash[20], struct public_key *key, BN_CTX *ctx);
+
+int pbo_checksum(char *path_pbo, unsigned char checksum[20]);
+
+int verify_pbo(char *path_pbo, char *path_signature, struct public_key *key);
+
+int verify_callback(char *root, char *source, char *data);
+
+int verify_task(int index, void *data);
+
+int cmd_verify();
@@ -6,8 +6,22 @@ mkdir -p /tmp/amktest || exit 1
 ./bin/armake img2paa test/paa/test.png /tmp/amktest/test.paa
 ./bin/armake img2paa test/paa/test_alpha.png /tmp/amktest/test_alpha.paa
 
+./bin/armake img2paa -q fast test/paa/test.png /tmp/amktest/test_fast.paa
+./bin/armake img2paa -q fast test/paa/test_alpha.png /tmp/amktest/test_alpha_fast.paa
+./bin/armake img2paa -t ARGB4444 test/paa/test_alpha.png /tmp/amktest/test_alpha_4444.paa
+./bin/armake img2paa -t ARGB1555 test/paa/test.png /tmp/amktest/test_1555.paa
+./bin/armake img2paa -t AI88 test/paa/test_alpha.png /tmp/amktest/test_alpha_88.paa
+
 ./bin/armake paa2img /tmp/amktest/test.paa /tmp/amktest/cmp.png
 ./bin/armake paa2img /tmp/amktest/test_alpha.paa /tmp/amktest/cmp_alpha.png
+./bin/armake paa2img /tmp/amktest/test_fast.paa /tmp/amktest/cmp_fast.png
+./bin/armake paa2img /tmp/amktest/test_alpha_fast.paa /tmp/amktest/cmp_alpha_fast.png
+./bin/armake paa2img /tmp/amktest/test_alpha_4444.paa /tmp/amktest/cmp_alpha_4444.png
+./bin/armake paa2img /tmp/amktest/test_1555.paa /tmp/amktest/cmp_1555.png
+./bin/armake paa2img /tmp/amktest/test_alpha_88.paa /tmp/amktest/cmp_alpha_88.png
+
+# AI88 only stores the intensity
+convert test/paa/test_alpha.png -grayscale Rec601Luma /tmp/amktest/test_alpha_gray.png
 
 compare -metric AE -fuzz 5% test/paa/test.png /tmp/amktest/cmp.png /dev/null 2> /dev/null || {
     rm -rf /tmp/amktest
@@ -19,4 +33,71 @@ compare -metric AE -fuzz 8% test/paa/test_alpha.png /tmp/amktest/cmp_alpha.png /
     exit 1
 }
 
+compare -metric AE -fuzz 5% test/paa/test.png /tmp/amktest/cmp_fast.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+compare -metric AE -fuzz 8% test/paa/test_alpha.png /tmp/amktest/cmp_alpha_fast.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+compare -metric AE -fuzz 8% test/paa/test_alpha.png /tmp/amktest/cmp_alpha_4444.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+compare -metric AE -fuzz 5% test/paa/test.png /tmp/amktest/cmp_1555.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+compare -metric AE -fuzz 3% /tmp/amktest/test_alpha_gray.png /tmp/amktest/cmp_alpha_88.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake img2paa -b test/paa /tmp/amktest/batch
+./bin/armake paa2img -b /tmp/amktest/batch /tmp/amktest/batch_png
+
+cmp /tmp/amktest/test.paa /tmp/amktest/batch/test.paa &&
+    cmp /tmp/amktest/test_alpha.paa /tmp/amktest/batch/test_alpha.paa &&
+    cmp /tmp/amktest/cmp.png /tmp/amktest/batch_png/test.png &&
+    cmp /tmp/amktest/cmp_alpha.png /tmp/amktest/batch_png/test_alpha.png || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# sources only differing in extension share a target, only the first is converted
+mkdir -p /tmp/amktest/same_target
+cp test/paa/test.png /tmp/amktest/same_target/test.png
+cp test/paa/test_alpha.png /tmp/amktest/same_target/test.tga
+
+./bin/armake img2paa -b /tmp/amktest/same_target /tmp/amktest/same_target_paa 2>&1 | grep -q "same target" &&
+    cmp /tmp/amktest/test.paa /tmp/amktest/same_target_paa/test.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake img2paa -z -l best test/paa/test.png /tmp/amktest/test_best.paa
+./bin/armake paa2img /tmp/amktest/test_best.paa /tmp/amktest/cmp_best.png
+./bin/armake paa2img -m 0 /tmp/amktest/test.paa /tmp/amktest/cmp_mip.png
+./bin/armake paa2img -m 1 /tmp/amktest/test.paa /tmp/amktest/cmp_mip1.png
+./bin/armake paa2img -M 1 /tmp/amktest/test.paa /tmp/amktest/cmp_small.png
+
+cmp /tmp/amktest/cmp.png /tmp/amktest/cmp_mip.png &&
+    cmp /tmp/amktest/cmp.png /tmp/amktest/cmp_best.png &&
+    [ "$(identify -format %wx%h /tmp/amktest/cmp_mip1.png)" = "1024x1024" ] &&
+    [ "$(identify -format %wx%h /tmp/amktest/cmp_small.png)" = "1x1" ] || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# trailing garbage in the MipMap index is rejected
+./bin/armake paa2img -m 1x /tmp/amktest/test.paa /tmp/amktest/cmp_invalid.png 2> /dev/null && {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
 rm -rf /tmp/amktest
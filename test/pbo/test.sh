@@ -13,4 +13,76 @@ cmp --silent /tmp/amktest/sample/foo /tmp/amktest/unpacked/foo || {
     exit 1
 }
 
+./bin/armake cat /tmp/amktest/foo.pbo FOO | cmp --silent /tmp/amktest/sample/foo - || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# a PBO with duplicate entries, of which the last one per file has to win
+{
+    printf '\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0'
+    for name in a.txt a.txt A.txt; do
+        printf '%s\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\1\0\0\0' "$name"
+    done
+    printf '\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0'
+    printf '123'
+    head -c 21 < /dev/zero
+} > /tmp/amktest/dupes.pbo
+./bin/armake unpack -f /tmp/amktest/dupes.pbo /tmp/amktest/dupes
+
+[ "$(cat /tmp/amktest/dupes/A.txt)" = "3" ] || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# on case sensitive filesystems a.txt is a different file
+[ /tmp/amktest/dupes/a.txt -ef /tmp/amktest/dupes/A.txt ] || [ "$(cat /tmp/amktest/dupes/a.txt)" = "2" ] || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# a PBO with LZSS compressed entries: three literals and a back reference
+# expanding to "abcabcabcabc", followed by the checksum, which is broken
+# for bad.txt
+{
+    printf '\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0'
+    for name in good.txt bad.txt; do
+        printf '%s\0srpC\x0c\0\0\0\0\0\0\0\0\0\0\0\x0a\0\0\0' "$name"
+    done
+    printf '\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0'
+    printf '\x07abc\x03\x06\x98\x04\0\0'
+    printf '\x07abc\x03\x06\x99\x04\0\0'
+    head -c 21 < /dev/zero
+} > /tmp/amktest/cprs.pbo
+
+./bin/armake inspect /tmp/amktest/cprs.pbo | grep -q "^good.txt *Cprs" || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+[ "$(./bin/armake cat /tmp/amktest/cprs.pbo good.txt)" = "abcabcabcabc" ] || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake cat /tmp/amktest/cprs.pbo bad.txt > /dev/null 2>&1 && {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake unpack -f -x bad.txt /tmp/amktest/cprs.pbo /tmp/amktest/cprs || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+[ "$(cat /tmp/amktest/cprs/good.txt)" = "abcabcabcabc" ] || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake unpack -f /tmp/amktest/cprs.pbo /tmp/amktest/cprs > /dev/null 2>&1 && {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
 rm -rf /tmp/amktest
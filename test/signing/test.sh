@@ -5,8 +5,7 @@ mkdir -p /tmp/amktest || exit 1
 
 cp test/signing/*.pbo /tmp/amktest/
 
-./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/ace_fcs.pbo
-./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/ace_vehiclelock.pbo
+./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/ace_fcs.pbo /tmp/amktest/ace_vehiclelock.pbo
 ./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/dbo_old_bike.pbo
 ./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/ace_medical.pbo
 
@@ -22,6 +21,64 @@ cmp --silent test/signing/ace_vehiclelock.pbo.*.bisign /tmp/amktest/ace_vehiclel
     exit 1
 }
 
+./bin/armake verify test/signing/*.bikey /tmp/amktest/ace_fcs.pbo /tmp/amktest/ace_vehiclelock.pbo || {
+    rm -rf /tmp/amktest
+    echo "verify"
+    exit 1
+}
+
+cp /tmp/amktest/ace_vehiclelock.pbo /tmp/amktest/modified.pbo
+printf "\xff" | dd of=/tmp/amktest/modified.pbo bs=1 seek=$(($(wc -c < /tmp/amktest/modified.pbo) - 100)) conv=notrunc 2> /dev/null
+
+./bin/armake verify test/signing/*.bikey /tmp/amktest/modified.pbo /tmp/amktest/ace_vehiclelock.pbo.*.bisign 2> /dev/null && {
+    rm -rf /tmp/amktest
+    echo "verify modified"
+    exit 1
+}
+
+./bin/armake keygen /tmp/amktest/other
+cp /tmp/amktest/ace_fcs.pbo /tmp/amktest/other.pbo
+./bin/armake sign /tmp/amktest/other.biprivatekey /tmp/amktest/other.pbo
+
+./bin/armake verify test/signing/*.bikey /tmp/amktest/other.pbo /tmp/amktest/other.pbo.other.bisign 2> /dev/null && {
+    rm -rf /tmp/amktest
+    echo "verify other key"
+    exit 1
+}
+
+# build -k has to sign exactly like sign does, also with header extensions
+# and without any hashed files
+mkdir -p /tmp/amktest/hashed/sub /tmp/amktest/nothing
+echo "hint 'foo';" > /tmp/amktest/hashed/script.sqf
+echo "bar" > /tmp/amktest/hashed/sub/data.txt
+head -c 100 < /dev/zero > /tmp/amktest/hashed/sub/sound.ogg
+head -c 100 < /dev/zero > /tmp/amktest/nothing/sound.ogg
+head -c 100 < /dev/zero > /tmp/amktest/nothing/sound.wss
+
+for folder in hashed nothing; do
+    ./bin/armake build -f -e version=1 -e prefix=test\\$folder -k test/signing/*.biprivatekey \
+        /tmp/amktest/$folder /tmp/amktest/$folder.pbo || {
+        rm -rf /tmp/amktest
+        echo "build -k $folder"
+        exit 1
+    }
+
+    mv /tmp/amktest/$folder.pbo.*.bisign /tmp/amktest/$folder.build.bisign
+    ./bin/armake sign test/signing/*.biprivatekey /tmp/amktest/$folder.pbo
+
+    cmp --silent /tmp/amktest/$folder.build.bisign /tmp/amktest/$folder.pbo.*.bisign || {
+        rm -rf /tmp/amktest
+        echo "build -k $folder"
+        exit 1
+    }
+
+    ./bin/armake verify test/signing/*.bikey /tmp/amktest/$folder.pbo /tmp/amktest/$folder.build.bisign || {
+        rm -rf /tmp/amktest
+        echo "verify build -k $folder"
+        exit 1
+    }
+done
+
 cmp --silent test/signing/dbo_old_bike.pbo.*.bisign /tmp/amktest/dbo_old_bike.pbo.*.bisign || {
     rm -rf /tmp/amktest
     echo "dbo_old_bike"